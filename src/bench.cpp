@@ -0,0 +1,163 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "modules.hpp"
+
+/* Spatial hash under churn, see pse/spatial.hpp. Every frame each entity
+   takes a step, some leave and as many come back somewhere else, then the
+   queries agents would make are run against it. Times are printed every
+   second of frames and after the last frame it quits. */
+
+constexpr int BENCH_ENTITIES = 100000;
+constexpr float BENCH_WORLD = 1024.0f; // tiles on a side
+constexpr float BENCH_CELL = 4.0f;
+constexpr float BENCH_SPEED = 0.25f; // most tiles moved in a frame
+constexpr int BENCH_CHURN = 1000; // removed and inserted again each frame
+constexpr int BENCH_QUERIES = 1000; // each of radius and rect
+constexpr int BENCH_NEAREST = 100;
+constexpr float BENCH_RADIUS = 6.0f;
+constexpr int BENCH_K = 8;
+constexpr size_t BENCH_FRAMES = 600;
+
+using namespace pse;
+using bench_clock = std::chrono::steady_clock;
+
+struct BenchEntity {
+    float x;
+    float y;
+    float vx;
+    float vy;
+};
+
+struct BenchTimes {
+    double move = 0.0;
+    double churn = 0.0;
+    double radius = 0.0;
+    double rect = 0.0;
+    double nearest = 0.0;
+    size_t found = 0;
+};
+
+static spatial_hash grid{};
+static std::vector<BenchEntity> entities{};
+static std::vector<uint32_t> results{};
+static BenchTimes window{};
+static BenchTimes total{};
+static size_t frames = 0;
+
+static inline double us_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+}
+
+static inline float random_coord()
+{
+    return rand_uniform() * BENCH_WORLD;
+}
+
+static void bench_print(const char *label, const BenchTimes& t, size_t n)
+{
+    printf("%s %zu frames: move %.1f us, churn %.1f us, radius %.1f us, rect %.1f us, nearest %.1f us, %zu found\n",
+        label, n, t.move / n, t.churn / n, t.radius / n, t.rect / n, t.nearest / n, t.found / n);
+}
+
+void bench_setup(context& ctx)
+{
+    (void)ctx;
+    grid.resize(BENCH_WORLD, BENCH_WORLD, BENCH_CELL);
+    entities.resize(BENCH_ENTITIES);
+    results.reserve(BENCH_ENTITIES);
+
+    auto start = bench_clock::now();
+    for (uint32_t i = 0; i < (uint32_t)entities.size(); i++) {
+        BenchEntity& e = entities[i];
+        e.x = random_coord();
+        e.y = random_coord();
+        e.vx = (rand_uniform() * 2.0f - 1.0f) * BENCH_SPEED;
+        e.vy = (rand_uniform() * 2.0f - 1.0f) * BENCH_SPEED;
+        grid.insert(i, e.x, e.y);
+    }
+    printf("Inserted %d entities in %.1f us\n", BENCH_ENTITIES, us_since(start));
+}
+
+void bench_update(context& ctx)
+{
+    auto start = bench_clock::now();
+    for (uint32_t i = 0; i < (uint32_t)entities.size(); i++) {
+        BenchEntity& e = entities[i];
+        e.x += e.vx;
+        e.y += e.vy;
+        // bounce off the edges
+        if (e.x < 0.0f || e.x >= BENCH_WORLD) {
+            e.vx = -e.vx;
+            e.x += 2.0f * e.vx;
+        }
+        if (e.y < 0.0f || e.y >= BENCH_WORLD) {
+            e.vy = -e.vy;
+            e.y += 2.0f * e.vy;
+        }
+        grid.move(i, e.x, e.y);
+    }
+    window.move += us_since(start);
+
+    start = bench_clock::now();
+    for (int n = 0; n < BENCH_CHURN; n++) {
+        uint32_t i = (uint32_t)(rand_uniform() * (BENCH_ENTITIES - 1)); // rand() may only reach 32767
+        BenchEntity& e = entities[i];
+        grid.erase(i);
+        e.x = random_coord();
+        e.y = random_coord();
+        grid.insert(i, e.x, e.y);
+    }
+    window.churn += us_since(start);
+
+    start = bench_clock::now();
+    for (int n = 0; n < BENCH_QUERIES; n++) {
+        results.clear();
+        grid.query_radius(random_coord(), random_coord(), BENCH_RADIUS, results);
+        window.found += results.size();
+    }
+    window.radius += us_since(start);
+
+    start = bench_clock::now();
+    for (int n = 0; n < BENCH_QUERIES; n++) {
+        results.clear();
+        grid.query_rect(random_coord(), random_coord(), 2.0f * BENCH_RADIUS, 2.0f * BENCH_RADIUS, results);
+        window.found += results.size();
+    }
+    window.rect += us_since(start);
+
+    start = bench_clock::now();
+    for (int n = 0; n < BENCH_NEAREST; n++) {
+        results.clear();
+        grid.query_nearest(random_coord(), random_coord(), BENCH_K, results);
+        window.found += results.size();
+    }
+    window.nearest += us_since(start);
+
+    frames++;
+    if (frames % ctx.frame_target == 0) {
+        bench_print("Last", window, ctx.frame_target);
+        total.move += window.move;
+        total.churn += window.churn;
+        total.radius += window.radius;
+        total.rect += window.rect;
+        total.nearest += window.nearest;
+        total.found += window.found;
+        window = BenchTimes{};
+    }
+    if (frames >= BENCH_FRAMES) {
+        ctx.quit();
+    }
+}
+
+void bench_cleanup(context& ctx)
+{
+    size_t counted = frames - frames % ctx.frame_target;
+    if (counted > 0) {
+        bench_print("All", total, counted);
+    }
+    entities.clear();
+    grid.resize(BENCH_WORLD, BENCH_WORLD, BENCH_CELL);
+}
@@ -0,0 +1,369 @@
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FLOW_SSE2
+#endif
+
+#include "flow.hpp"
+
+using namespace pse;
+
+static const int dir_x[4] = { 1, 0, -1, 0 };
+static const int dir_y[4] = { 0, 1, 0, -1 };
+
+static inline uint64_t goal_key(int wx, int wy, int w, int h)
+{
+    return ((uint64_t)(uint16_t)wx << 48) | ((uint64_t)(uint16_t)wy << 32) |
+           ((uint64_t)(uint16_t)w << 16) | (uint64_t)(uint16_t)h;
+}
+
+int FlowField::distance(int wx, int wy) const
+{
+    int32_t c = cost[wy * width + wx];
+    return c == FLOW_UNREACHABLE ? -1 : c;
+}
+
+int FlowField::dir(int wx, int wy) const
+{
+    return dirs[wy * width + wx];
+}
+
+ivec2 FlowField::step(int wx, int wy) const
+{
+    int d = dirs[wy * width + wx];
+    return d == FLOW_NONE ? ivec2{ 0, 0 } : ivec2{ dir_x[d], dir_y[d] };
+}
+
+/**
+ * Pull a row towards the one next to it, row = min(row, from + 1)
+ * everywhere but the walls. True if anything got closer.
+ */
+static bool relax_row(int32_t *row, const int32_t *from, const int32_t *wall, int n)
+{
+    int k = 0;
+    bool changed = false;
+#ifdef FLOW_SSE2
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i closer_any = _mm_setzero_si128();
+    for (; k + 4 <= n; k += 4) {
+        __m128i cur = _mm_loadu_si128((const __m128i *)(row + k));
+        __m128i w = _mm_loadu_si128((const __m128i *)(wall + k));
+        // unreachable leaves room for the 1, SSE2 has no 32 bit min so it's picked with a compare
+        __m128i near = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(from + k)), one);
+        __m128i closer = _mm_andnot_si128(w, _mm_cmplt_epi32(near, cur));
+        closer_any = _mm_or_si128(closer_any, closer);
+        _mm_storeu_si128((__m128i *)(row + k), _mm_or_si128(_mm_and_si128(closer, near), _mm_andnot_si128(closer, cur)));
+    }
+    changed = _mm_movemask_epi8(closer_any) != 0;
+#endif
+    for (; k < n; k++) {
+        int v = from[k] + 1;
+        if (!wall[k] && v < row[k]) {
+            row[k] = v;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/**
+ * Sweep a chunk down, up, right and left until nothing changes,
+ * reading the tiles just outside of it. True if anything changed.
+ */
+static bool relax_chunk(int32_t *cost, const int32_t *wall, int width, int height, int x0, int y0, int x1, int y1)
+{
+    const int n = x1 - x0;
+    bool any = false;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int y = std::max(y0, 1); y < y1; y++) {
+            changed |= relax_row(cost + y * width + x0, cost + (y - 1) * width + x0, wall + y * width + x0, n);
+        }
+        for (int y = std::min(y1, height - 1) - 1; y >= y0; y--) {
+            changed |= relax_row(cost + y * width + x0, cost + (y + 1) * width + x0, wall + y * width + x0, n);
+        }
+        for (int y = y0; y < y1; y++) {
+            int32_t *row = cost + y * width;
+            const int32_t *w = wall + y * width;
+            int run = x0 > 0 ? row[x0 - 1] : FLOW_UNREACHABLE;
+            for (int x = x0; x < x1; x++) {
+                if (!w[x] && run + 1 < row[x]) {
+                    row[x] = run + 1;
+                    changed = true;
+                }
+                run = row[x];
+            }
+            run = x1 < width ? row[x1] : FLOW_UNREACHABLE;
+            for (int x = x1 - 1; x >= x0; x--) {
+                if (!w[x] && run + 1 < row[x]) {
+                    row[x] = run + 1;
+                    changed = true;
+                }
+                run = row[x];
+            }
+        }
+        any |= changed;
+    }
+    return any;
+}
+
+FlowFields::FlowFields(PathFinder& paths, pool& workers)
+: paths{paths}, workers{workers}
+{
+
+}
+
+/**
+ * Copy the walkability of chunks that changed since they were last copied
+ */
+void FlowFields::walls_update()
+{
+    const int width = paths.width;
+    const int height = paths.height;
+    const int size = paths.chunk_size;
+    const int wide = paths.chunks_wide;
+    const int count = wide * paths.chunks_tall;
+    const bool all = (int)walls.size() != width * height || (int)wall_versions.size() != count;
+    if (all) {
+        walls.resize(width * height);
+        wall_versions.resize(count);
+    }
+
+    for (int c = 0; c < count; c++) {
+        if (!all && wall_versions[c] == paths.chunk_version(c)) {
+            continue;
+        }
+        const bitgrid& blocked = paths.chunk_walls(c);
+        int x0 = (c % wide) * size;
+        int y0 = (c / wide) * size;
+        for (int y = y0; y < std::min(y0 + size, height); y++) {
+            for (int x = x0; x < std::min(x0 + size, width); x++) {
+                walls[y * width + x] = blocked.get(x - x0, y - y0) ? -1 : 0;
+            }
+        }
+        wall_versions[c] = paths.chunk_version(c);
+    }
+}
+
+/**
+ * True if a tile of chunk c along its border with chunk n steps into n
+ */
+static bool steps_into(const FlowField& f, int size, int wide, int c, int n)
+{
+    int x0 = (c % wide) * size;
+    int y0 = (c / wide) * size;
+    int x1 = std::min(x0 + size, f.width);
+    int y1 = std::min(y0 + size, f.height);
+    int d;
+    if (n == c + 1) {
+        d = FLOW_EAST;
+        x0 = x1 - 1;
+    }
+    else if (n == c - 1) {
+        d = FLOW_WEST;
+        x1 = x0 + 1;
+    }
+    else if (n > c) {
+        d = FLOW_SOUTH;
+        y0 = y1 - 1;
+    }
+    else {
+        d = FLOW_NORTH;
+        y1 = y0 + 1;
+    }
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            if (f.dirs[y * f.width + x] == d) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Bring a field up to date with the pathfinder. A new field is relaxed out
+ * from the goal. Otherwise only the chunks that changed since it was built,
+ * and the chunks whose tiles step into those, are cleared and relaxed again.
+ * The rest of the field never went through the changed chunks so it stands.
+ */
+void FlowFields::build(FlowField& f)
+{
+    const int width = paths.width;
+    const int height = paths.height;
+    const int size = paths.chunk_size;
+    const int wide = paths.chunks_wide;
+    const int tall = paths.chunks_tall;
+    const int count = wide * tall;
+
+    std::vector<char> active(count, 0);
+    std::vector<char> touched(count, 0); // costs may have changed
+    const bool full = f.width != width || f.height != height || (int)f.versions.size() != count;
+    if (full) {
+        f.width = width;
+        f.height = height;
+        f.versions.resize(count);
+        f.cost.assign(width * height, FLOW_UNREACHABLE);
+        f.dirs.assign(width * height, FLOW_NONE);
+        std::fill(touched.begin(), touched.end(), 1);
+    }
+    else {
+        std::vector<int> spread;
+        for (int c = 0; c < count; c++) {
+            if (f.versions[c] != paths.chunk_version(c)) {
+                touched[c] = 1;
+                spread.push_back(c);
+            }
+        }
+        if (spread.empty()) {
+            return;
+        }
+        while (!spread.empty()) {
+            int c = spread.back();
+            spread.pop_back();
+            int cx = c % wide;
+            int cy = c / wide;
+            int next[4] = {
+                cx + 1 < wide ? c + 1 : -1,
+                cx > 0 ? c - 1 : -1,
+                cy + 1 < tall ? c + wide : -1,
+                cy > 0 ? c - wide : -1,
+            };
+            for (int n : next) {
+                if (n != -1 && !touched[n] && steps_into(f, size, wide, n, c)) {
+                    touched[n] = 1;
+                    spread.push_back(n);
+                }
+            }
+        }
+        for (int c = 0; c < count; c++) {
+            if (!touched[c]) {
+                continue;
+            }
+            int x0 = (c % wide) * size;
+            int y0 = (c / wide) * size;
+            for (int y = y0; y < std::min(y0 + size, height); y++) {
+                std::fill(&f.cost[y * width + x0], &f.cost[y * width + std::min(x0 + size, width)], FLOW_UNREACHABLE);
+            }
+            active[c] = 1;
+        }
+    }
+    for (int c = 0; c < count; c++) {
+        f.versions[c] = paths.chunk_version(c);
+    }
+
+    // the goal is walkable while this field is relaxed
+    const int gx0 = std::max(f.gx, 0);
+    const int gy0 = std::max(f.gy, 0);
+    const int gx1 = std::min(f.gx + f.gw, width);
+    const int gy1 = std::min(f.gy + f.gh, height);
+    for (int y = gy0; y < gy1; y++) {
+        for (int x = gx0; x < gx1; x++) {
+            int c = (y / size) * wide + x / size;
+            walls[y * width + x] = 0;
+            f.cost[y * width + x] = 0;
+            active[c] = active[c] || full;
+        }
+    }
+
+    // the colors take turns, a chunk that changed wakes its neighbours
+    std::vector<char> changed(count, 0);
+    std::vector<int> run;
+    for (bool pending = true; pending; ) {
+        pending = false;
+        for (int color = 0; color < 2; color++) {
+            run.clear();
+            for (int c = 0; c < count; c++) {
+                if (active[c] && (c % wide + c / wide) % 2 == color) {
+                    run.push_back(c);
+                    active[c] = 0;
+                }
+            }
+            workers.parallel_for((int)run.size(), [&](int i) {
+                int c = run[i];
+                int x0 = (c % wide) * size;
+                int y0 = (c / wide) * size;
+                changed[c] = relax_chunk(f.cost.data(), walls.data(), width, height,
+                    x0, y0, std::min(x0 + size, width), std::min(y0 + size, height));
+            });
+            for (int c : run) {
+                if (!changed[c]) {
+                    continue;
+                }
+                touched[c] = 1;
+                int cx = c % wide;
+                int cy = c / wide;
+                if (cx > 0) active[c - 1] = 1;
+                if (cx + 1 < wide) active[c + 1] = 1;
+                if (cy > 0) active[c - wide] = 1;
+                if (cy + 1 < tall) active[c + wide] = 1;
+                pending = true;
+            }
+        }
+    }
+
+    for (int y = gy0; y < gy1; y++) {
+        for (int x = gx0; x < gx1; x++) {
+            walls[y * width + x] = paths.walkable(x, y) ? 0 : -1;
+        }
+    }
+
+    // downhill from every tile of the chunks whose costs or neighbours' costs changed
+    run.clear();
+    for (int c = 0; c < count; c++) {
+        int cx = c % wide;
+        int cy = c / wide;
+        if (touched[c] || (cx > 0 && touched[c - 1]) || (cx + 1 < wide && touched[c + 1]) ||
+            (cy > 0 && touched[c - wide]) || (cy + 1 < tall && touched[c + wide]))
+        {
+            run.push_back(c);
+        }
+    }
+    workers.parallel_for((int)run.size(), [&](int i) {
+        int c = run[i];
+        int x0 = (c % wide) * size;
+        int y0 = (c / wide) * size;
+        for (int y = y0; y < std::min(y0 + size, height); y++) {
+            for (int x = x0; x < std::min(x0 + size, width); x++) {
+                int32_t best = f.cost[y * width + x];
+                f.dirs[y * width + x] = FLOW_NONE;
+                if (best == 0 || best == FLOW_UNREACHABLE) {
+                    continue;
+                }
+                for (int d = 0; d < 4; d++) {
+                    int nx = x + dir_x[d];
+                    int ny = y + dir_y[d];
+                    if (nx >= 0 && nx < width && ny >= 0 && ny < height && f.cost[ny * width + nx] < best) {
+                        best = f.cost[ny * width + nx];
+                        f.dirs[y * width + x] = (uint8_t)d;
+                    }
+                }
+            }
+        }
+    });
+}
+
+const FlowField& FlowFields::field(int wx, int wy, int w, int h)
+{
+    walls_update();
+
+    const uint64_t key = goal_key(wx, wy, w, h);
+    auto it = field_of_goal.find(key);
+    if (it != field_of_goal.end()) {
+        fields.splice(fields.begin(), fields, it->second);
+        build(*it->second);
+        return *it->second;
+    }
+
+    fields.push_front(FlowField{ 0, 0, wx, wy, w, h, {}, {}, {} });
+    field_of_goal[key] = fields.begin();
+    if ((int)fields.size() > capacity) {
+        const FlowField& last = fields.back();
+        field_of_goal.erase(goal_key(last.gx, last.gy, last.gw, last.gh));
+        fields.pop_back();
+    }
+    build(fields.front());
+    return fields.front();
+}
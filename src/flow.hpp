@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "pse/pse.hpp"
+#include "path.hpp"
+
+// same order as RoadDir
+enum FlowDir {
+    FLOW_EAST,
+    FLOW_SOUTH,
+    FLOW_WEST,
+    FLOW_NORTH,
+    FLOW_NONE, // at the goal, or the goal can't be reached
+};
+
+constexpr int32_t FLOW_UNREACHABLE = INT32_MAX - 1; // past any path, with room to add one step
+
+/**
+ * Steps from every tile to a goal and which way to step, so any number
+ * of agents heading there only look up the tile they are standing on.
+ */
+struct FlowField {
+    int width;
+    int height;
+    int gx; // goal rect, its tiles count as walkable
+    int gy;
+    int gw;
+    int gh;
+    std::vector<unsigned> versions; // of each chunk when the field was last brought up to date
+    std::vector<int32_t> cost; // FLOW_UNREACHABLE where the goal can't be reached
+    std::vector<uint8_t> dirs; // FlowDir
+
+    int distance(int wx, int wy) const; // -1 if it can't be reached
+    int dir(int wx, int wy) const;
+    pse::ivec2 step(int wx, int wy) const; // offset to the next tile, 0, 0 at the goal or when stuck
+};
+
+/**
+ * Builds flow fields over the pathfinder's walkable tiles and keeps the
+ * recently used ones. Edits make the chunks they're in stale, along with
+ * any chunk whose tiles step into those, and just those are relaxed again
+ * the next time a field is asked for.
+ *
+ * Chunks relax their own tiles in sweeps across and down the chunk, the
+ * vertical sweeps 4 tiles at a time. Chunks are split like a checkerboard
+ * and the two colors take turns, so a chunk's neighbours are never being
+ * written while it reads the tiles along their border.
+ */
+class FlowFields {
+public:
+    FlowFields(PathFinder& paths, pse::pool& workers);
+    const FlowField& field(int wx, int wy, int w = 1, int h = 1); // goal rect, only good until the next call, which may drop it for another
+    int capacity = 16;
+private:
+    PathFinder& paths;
+    pse::pool& workers;
+    std::list<FlowField> fields{}; // most recently used first
+    std::unordered_map<uint64_t, std::list<FlowField>::iterator> field_of_goal{};
+    std::vector<int32_t> walls{}; // -1 on tiles that aren't walkable
+    std::vector<unsigned> wall_versions{}; // chunk versions walls were copied at
+
+    void walls_update();
+    void build(FlowField& f);
+};
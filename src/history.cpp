@@ -0,0 +1,92 @@
+#include "history.hpp"
+#include "save.hpp"
+#include "pse/arena.hpp"
+
+using namespace pse;
+
+bool history_delta(const ChunkCodes *before, const ChunkCodes *after, int count, std::vector<uint8_t>& out)
+{
+    const uint8_t *b = before ? before->data() : nullptr;
+    const uint8_t *a = after ? after->data() : nullptr;
+
+    frame_vector<uint8_t> x(count);
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+        x[i] = (uint8_t)((b ? b[i] : 0) ^ (a ? a[i] : 0));
+        changed = changed || x[i] != 0;
+    }
+    if (changed) {
+        save_encode(x.data(), count, out);
+    }
+    return changed;
+}
+
+bool history_delta_apply(const std::vector<uint8_t>& delta, uint8_t *codes, int count)
+{
+    frame_vector<uint8_t> x(count);
+    if (!save_decode(delta.data(), delta.size(), x.data(), count)) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        codes[i] ^= x[i];
+    }
+    return true;
+}
+
+void History::push(HistoryStep&& step)
+{
+    for (const HistoryStep& r : redos) {
+        bytes -= r.bytes;
+    }
+    redos.clear();
+    step.bytes = sizeof(HistoryStep);
+    for (const HistoryChunk& c : step.chunks) {
+        step.bytes += sizeof(HistoryChunk) + c.delta.size();
+    }
+    bytes += step.bytes;
+    undos.push_back(std::move(step));
+    trim();
+}
+
+const HistoryStep *History::undo()
+{
+    if (undos.empty()) {
+        return nullptr;
+    }
+    redos.push_back(std::move(undos.back()));
+    undos.pop_back();
+    return &redos.back();
+}
+
+const HistoryStep *History::redo()
+{
+    if (redos.empty()) {
+        return nullptr;
+    }
+    undos.push_back(std::move(redos.back()));
+    redos.pop_back();
+    return &undos.back();
+}
+
+void History::clear()
+{
+    undos.clear();
+    redos.clear();
+    bytes = 0;
+}
+
+size_t History::size() const
+{
+    return bytes;
+}
+
+/**
+ * Only undo steps go, a step being redone is always newer than them
+ */
+void History::trim()
+{
+    while (bytes > HISTORY_BYTES && undos.size() > 1) {
+        bytes -= undos.front().bytes;
+        undos.pop_front();
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "snapshot.hpp"
+
+constexpr size_t HISTORY_BYTES = 8 << 20; // most undo and redo kept, the oldest steps go first
+
+/* A step keeps, for each chunk it changed, the codes from before XOR the
+   codes after, run length encoded like a save. Mostly it's runs of 0, and
+   the same delta takes the chunk either way, so undo and redo share it. */
+struct HistoryChunk {
+    int chunk;
+    std::vector<uint8_t> delta;
+};
+
+struct HistoryStep {
+    std::vector<HistoryChunk> chunks;
+    size_t bytes = 0;
+};
+
+bool history_delta(const ChunkCodes *before, const ChunkCodes *after, int count, std::vector<uint8_t>& out); // false if nothing changed, null is all 0
+bool history_delta_apply(const std::vector<uint8_t>& delta, uint8_t *codes, int count); // false if it's corrupt
+
+/**
+ * Undo and redo stacks of steps, held under HISTORY_BYTES
+ */
+class History {
+public:
+    void push(HistoryStep&& step); // the redo stack is dropped
+    const HistoryStep *undo(); // moves the last step onto the redo stack, null if there's none
+    const HistoryStep *redo();
+    void clear();
+    size_t size() const; // bytes held
+private:
+    std::deque<HistoryStep> undos{};
+    std::vector<HistoryStep> redos{};
+    size_t bytes = 0;
+
+    void trim();
+};
@@ -0,0 +1,231 @@
+#include <chrono>
+
+#include "journal.hpp"
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        v |= (uint32_t)p[i] << (i * 8);
+    }
+    return v;
+}
+
+static inline void put_varint(std::vector<uint8_t>& out, uint32_t n)
+{
+    while (n >= 0x80) {
+        out.push_back((uint8_t)(n | 0x80));
+        n >>= 7;
+    }
+    out.push_back((uint8_t)n);
+}
+
+static inline bool get_varint(const uint8_t *data, size_t size, size_t& p, int& out)
+{
+    uint32_t n = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= size) {
+            return false;
+        }
+        uint8_t b = data[p++];
+        n |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            out = (int)n;
+            return true;
+        }
+    }
+    return false;
+}
+
+// FNV-1a
+static uint32_t checksum(const uint8_t *data, size_t size)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+Journal::Journal()
+{
+    writer = std::thread(&Journal::run, this);
+}
+
+Journal::~Journal()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    writer.join();
+    close();
+}
+
+void Journal::write_batch(std::vector<uint8_t>& batch)
+{
+    if (!file || batch.empty()) {
+        return;
+    }
+    uint8_t head[8];
+    put_u32(head, (uint32_t)batch.size());
+    put_u32(head + 4, checksum(batch.data(), batch.size()));
+    fwrite(head, 1, sizeof(head), file);
+    fwrite(batch.data(), 1, batch.size(), file);
+    fflush(file);
+}
+
+/**
+ * Take whatever was recorded and write it, until told to stop
+ */
+void Journal::run()
+{
+    std::vector<uint8_t> batch;
+    for (;;) {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait_for(guard, std::chrono::milliseconds(JOURNAL_FLUSH_MS), [this]() { return stopping; });
+            stop = stopping;
+        }
+        // held from the swap through the write, so the batch goes to the file it was recorded for
+        {
+            std::lock_guard<std::mutex> guard(io);
+            take(batch);
+            write_batch(batch);
+        }
+        batch.clear();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void Journal::take(std::vector<uint8_t>& batch)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    batch.swap(pending);
+}
+
+/**
+ * Write what's left and close the file, io must be held
+ */
+void Journal::finish()
+{
+    std::vector<uint8_t> batch;
+    take(batch);
+    write_batch(batch);
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool Journal::open(const std::string& path, uint64_t base)
+{
+    std::lock_guard<std::mutex> guard(io);
+    finish();
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open journal %s\n", path.c_str());
+        return false;
+    }
+    uint8_t head[16];
+    put_u32(head, JOURNAL_MAGIC);
+    put_u32(head + 4, JOURNAL_VERSION);
+    put_u32(head + 8, (uint32_t)base);
+    put_u32(head + 12, (uint32_t)(base >> 32));
+    fwrite(head, 1, sizeof(head), file);
+    fflush(file);
+    recorded = 0;
+    return true;
+}
+
+void Journal::close()
+{
+    std::lock_guard<std::mutex> guard(io);
+    finish();
+}
+
+bool Journal::is_open() const
+{
+    return file != nullptr;
+}
+
+void Journal::record(const JournalRecord& r)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t before = pending.size();
+    pending.push_back((uint8_t)r.op);
+    if (r.op == JOURNAL_PLACE || r.op == JOURNAL_FILL) {
+        pending.push_back((uint8_t)r.name);
+    }
+    put_varint(pending, (uint32_t)r.x);
+    put_varint(pending, (uint32_t)r.y);
+    if (r.op == JOURNAL_FILL || r.op == JOURNAL_CLEAR) {
+        put_varint(pending, (uint32_t)r.w);
+        put_varint(pending, (uint32_t)r.h);
+    }
+    recorded += pending.size() - before;
+}
+
+size_t Journal::size() const
+{
+    return recorded;
+}
+
+bool Journal::replay(const std::string& path, uint64_t& base, std::vector<JournalRecord>& out)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    if (data.size() < 16 || get_u32(&data[0]) != JOURNAL_MAGIC || get_u32(&data[4]) != JOURNAL_VERSION) {
+        return false;
+    }
+    base = get_u32(&data[8]) | ((uint64_t)get_u32(&data[12]) << 32);
+
+    size_t p = 16;
+    while (p + 8 <= data.size()) {
+        size_t len = get_u32(&data[p]);
+        if (len > data.size() - p - 8 || checksum(&data[p + 8], len) != get_u32(&data[p + 4])) {
+            break;
+        }
+        const uint8_t *batch = &data[p + 8];
+        size_t q = 0;
+        while (q < len) {
+            JournalRecord r{};
+            r.op = (JournalOp)batch[q++];
+            bool ok = true;
+            if (r.op == JOURNAL_PLACE || r.op == JOURNAL_FILL) {
+                ok = q < len;
+                r.name = ok ? batch[q++] : 0;
+            }
+            ok = ok && get_varint(batch, len, q, r.x) && get_varint(batch, len, q, r.y);
+            if (r.op == JOURNAL_FILL || r.op == JOURNAL_CLEAR) {
+                ok = ok && get_varint(batch, len, q, r.w) && get_varint(batch, len, q, r.h);
+            }
+            if (!ok || r.op < JOURNAL_PLACE || r.op > JOURNAL_CLEAR) {
+                return true;
+            }
+            out.push_back(r);
+        }
+        p += 8 + len;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* A journal is a header, then batches of records as they were flushed.
+   Each batch is its length and checksum then its records, so a batch
+   torn by a crash is where replay stops. Records are an op, the
+   TileName for ops that place, then their numbers as 7 bit groups,
+   low first. A journal holds the edits made on top of the snapshot
+   of the same generation. */
+
+constexpr uint32_t JOURNAL_MAGIC = 0x4c4a4d53; // "SMJL"
+constexpr uint32_t JOURNAL_VERSION = 1;
+constexpr int JOURNAL_FLUSH_MS = 200; // longest an edit waits before it's written
+
+enum JournalOp {
+    JOURNAL_PLACE = 1, // name, x, y
+    JOURNAL_REMOVE,    // x, y
+    JOURNAL_FILL,      // name, x, y, w, h
+    JOURNAL_CLEAR,     // x, y, w, h
+};
+
+struct JournalRecord {
+    JournalOp op;
+    int name;
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+/**
+ * Edits are recorded into a buffer, which costs next to nothing, and a
+ * thread of its own writes the buffer out every JOURNAL_FLUSH_MS so the
+ * game never waits on the disk.
+ */
+class Journal {
+public:
+    Journal();
+    ~Journal(); // writes what's left
+    bool open(const std::string& path, uint64_t base); // writes what's left, then starts a new file on top of snapshot base
+    void close();
+    bool is_open() const;
+    void record(const JournalRecord& r);
+    size_t size() const; // bytes recorded since open
+    static bool replay(const std::string& path, uint64_t& base, std::vector<JournalRecord>& out); // false if it isn't a journal
+private:
+    std::thread writer{};
+    std::mutex lock{}; // pending and stopping
+    std::condition_variable wake{};
+    std::vector<uint8_t> pending{};
+    bool stopping = false;
+    std::mutex io{}; // file, held while writing, taken before lock
+    FILE *file = nullptr;
+    size_t recorded = 0;
+
+    void take(std::vector<uint8_t>& batch); // swaps out pending
+    void write_batch(std::vector<uint8_t>& batch);
+    void finish();
+    void run();
+};
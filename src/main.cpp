@@ -5,13 +5,26 @@
 
 // TODO: Fix rand_range, divides by 0 sometimes?
 
+constexpr size_t ALLOC_WARMUP_FRAMES = 300; // frames of loading in and filling caches before --alloc-strict allows no allocations
+
 int main(int argc, char **argv)
 {
     auto ctx = pse::context("Simmil", PSE_RESOLUTION_43_1024_768, 60);
 
+    // see pse/alloc.hpp, only with a build that tracks allocations
+    if (arg_check(argc, argv, "--alloc-report") || arg_check(argc, argv, "--alloc-strict")) {
+        if (!pse::alloc_tracking()) {
+            fprintf(stderr, "Error: Allocations are only tracked when built with PSE_ALLOC_TRACK, see make alloctrack\n");
+        }
+        pse::alloc_track(arg_check(argc, argv, "--alloc-report"), arg_check(argc, argv, "--alloc-strict") ? ALLOC_WARMUP_FRAMES : 0);
+    }
+
     if (arg_check(argc, argv, "--demo")) {
         ctx.run(demo_setup, demo_update, NULL);
     }
+    else if (arg_check(argc, argv, "--bench-spatial")) {
+        ctx.run(bench_setup, bench_update, bench_cleanup);
+    }
     else {
         ctx.run(simmil_setup, simmil_update, simmil_cleanup);
     }
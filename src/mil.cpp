@@ -1,158 +1,166 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <thread>
 #include <vector>
-#include "modules.hpp"
 
-using namespace pse;
+#include "mil.hpp"
 
-// FIRST ITEM is DEFAULT
-enum TileName {
-    TILE_GRASS,
-    TILE_BUILDING_TENT,
-    TILE_HIGHLIGHT_MOUSE,
-    TILE_ROAD_DIRT_STRAIGHT_NS,
-    TILE_ROAD_DIRT_CORNER_NE,
-    TILE_ROAD_DIRT_CORNER_SE,
-    TILE_ROAD_DIRT_CORNER_SW,
-    TILE_ROAD_DIRT_CORNER_NW,
-    TILE_TEST_11,
-    TILE_TEST_22,
-    TILE_TEST_31,
-    TILE_TEST_224,
-    TILE_COUNT
-};
-
-constexpr int MAGIC_OFFSCREEN_MAX = 5;
-
-struct TileDefinition {
-    TileName name;
-    ivec3 worldsize; // number of tiles x/y/z the tile takes up
-    int id; // read-only, auto managed
-    // Tile{TILE_GRASS, ivec2{1, 1}, ctx.load_image("assets/tile_grass.png")};
-    TileDefinition();
-    TileDefinition(TileName name, ivec3 size, int id);
-};
+using namespace pse;
 
 TileDefinition::TileDefinition()
-: name{TILE_GRASS}, worldsize{1, 1, 1}, id{-1}
+: name{TILE_GRASS}, worldsize{1, 1, 1}, id{-1}, opaque{0}, flags{0}, influence{}
 {
 
 }
 
-TileDefinition::TileDefinition(TileName name, ivec3 size, int id)
-: name{name}, worldsize{size.x, size.y, size.z}, id{id}
+TileDefinition::TileDefinition(TileName name, ivec3 size, int id, uint64_t opaque, unsigned flags)
+: name{name}, worldsize{size.x, size.y, size.z}, id{id}, opaque{opaque}, flags{flags}, influence{}
 {
 
 }
 
-struct TileManager {
-    TileDefinition *definition;
-    /* Drawing can be complicated. The drawer has the coordinates
-       of where to draw, but you can only draw once you get to
-       the coordinates of the tile closest to the bottom of the
-       screen. Keep track of who is where. */
-    TileManager *drawer; // the one who can draw, closest to the top of the screen
-    TileManager *commander; // the one who commands the drawer, closest to bottom of screen
-    ivec2 world_coords;
-    TileManager();
-};
-
 TileManager::TileManager()
-: definition{nullptr}, drawer{nullptr}, commander{nullptr}, world_coords{}
-{
-
-}
-
-struct WorldData {
-    context& ctx;
-    TileManager *world; // array of tile managers
-
-    ivec2 screen_tilesize; // tile width and height in pixels
-    ivec2 world_origin;
-    ivec2 screen_offset;
-    int world_height; // grids of the world tall
-    int world_width; // grids of the world wide
-    int world_hdiag;
-    int world_vdiag;
-    component *menu_component; // managed by the context
-    component *world_component; // managed by the context
-private:
-    TileDefinition definitions[TILE_COUNT];
-    TileDefinition *defaultdef = definitions;
-
-public:
-    WorldData(context& ctx, int height, int width);
-    ~WorldData();
-    void setup();
-    void update();
-    ivec2 world_to_screen(int wx, int wy);
-    void tile_load(TileName name, int gridx, int gridy, int gridz, const char *path);
-    void tile_place(TileName name, int wx, int wy);
-    void tile_remove(int wx, int wy);
-    void tile_draw(int wx, int wy);
-};
+: definition{nullptr}, drawer{nullptr}, world_coords{}
+{
+
+}
+
+static inline SimKind sim_kind(const TileDefinition *def)
+{
+    if (def->flags & TILE_FLAG_ROAD) {
+        return SIM_ROAD;
+    }
+    return (def->flags & TILE_FLAG_GROUND) ? SIM_OPEN : SIM_BUILDING;
+}
+
+static inline unsigned utility_sources(const TileDefinition *def)
+{
+    return ((def->flags & TILE_FLAG_POWER) ? 1 << UTILITY_POWER : 0) |
+           ((def->flags & TILE_FLAG_WATER) ? 1 << UTILITY_WATER : 0);
+}
+
+static inline int floor_div(int a, int b)
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
 
 WorldData::WorldData(context& ctx, int height, int width)
 : ctx{ctx}, screen_tilesize{90, 45}, world_origin{width / 2, 1},
   world_height{height}, world_width{width}, world_hdiag{0}, world_vdiag{0},
-  menu_component{nullptr}, world_component{nullptr}
+  chunks_wide{(width + CHUNK_SIZE - 1) / CHUNK_SIZE}, chunks_tall{(height + CHUNK_SIZE - 1) / CHUNK_SIZE},
+  menu_component{}, world_component{}, path_queries{ctx.workers},
+  flows{paths, ctx.workers}, traffic{roads, ctx.workers}, sim{ctx.workers}
 {
     world_hdiag = fast_sqrtf(world_width * world_width * 2);
     world_vdiag = fast_sqrtf(world_height * world_height * 2);
 
     world = new TileManager[world_height * world_width];
-
-    // order in which they appear
-    world_component= new component{0, (int)(ctx.screen_height * 0.1), ctx.screen_width, (int)(ctx.screen_height * 0.9)};
-    ctx.component_add(world_component);
-    menu_component = new component{0, 0, ctx.screen_width, (int)(ctx.screen_height * 0.1)};
-    ctx.component_add(menu_component);
+    occupied.resize(world_width, world_height);
+    roads.resize(world_width, world_height);
+    paths.resize(world_width, world_height, CHUNK_SIZE);
+    sim.resize(world_width, world_height, CHUNK_SIZE);
+    utilities.resize(world_width, world_height);
+    chunk_pending.assign(chunks_wide * chunks_tall, 0);
+    chunk_table = std::make_shared<ChunkTable>(chunks_wide * chunks_tall);
+    history_marks.assign(chunks_wide * chunks_tall, 0);
+    chunk_requested.assign(chunks_wide * chunks_tall, 0);
+    chunk_prefetch.resize(chunks_wide * chunks_tall);
+    for (sumgrid& g : tile_counts) {
+        g.resize(world_width, world_height);
+    }
+    agent_cells.resize((float)world_width, (float)world_height, 1.0f);
+    for (Overlay& o : overlays) {
+        o.resize(world_width, world_height, CHUNK_SIZE, OVERLAY_RADIUS);
+    }
+    occluder.resize(ctx.screen_width, ctx.screen_height, 16);
 }
 
 WorldData::~WorldData()
 {
+    ctx.component_remove(world_component);
+    ctx.component_remove(menu_component);
+    for (int id : idle_jobs) {
+        ctx.background.remove(id);
+    }
     delete[] world;
 }
 
-void WorldData::tile_load(TileName name, int gridx, int gridy, int gridz, const char *path)
+void WorldData::tile_load(TileName name, int gridx, int gridy, int gridz, const char *path, unsigned flags)
 {
-    definitions[name] = TileDefinition{name, ivec3{gridx, gridy, gridz}, ctx.load_image(path)};
+    int id = ctx.load_image(path);
+    definitions[name] = TileDefinition{name, ivec3{gridx, gridy, gridz}, id, ctx.image_mask(id), flags};
+    tile_reach = std::max({tile_reach, gridx + gridy, gridz});
 }
 
 /**
- * Place something on the the default tile or tile with a null definition.
- * Tiles CANNOT be placed on any other tile.
- * All tiles that the new tile takes up MUST be the default tile.
+ * How strongly a tile spreads an overlay around it, set it
+ * after the tile is loaded and before any of it is placed
  */
-void WorldData::tile_place(TileName name, int wx, int wy)
+void WorldData::tile_influence(TileName name, OverlayKind kind, int strength)
 {
-    if (wx < 0 || wx >= world_width || wy < 0 || wy >= world_height) {
-        return;
+    assert(kind < OVERLAY_SPREAD);
+    assert(&definitions[name] != defaultdef);
+    definitions[name].influence[kind] = strength;
+}
+
+/**
+ * Add, or take away with a negative sign, what
+ * a tile spreads over every tile in the rect
+ */
+void WorldData::influence_apply(TileDefinition *def, int wx, int wy, int w, int h, int sign)
+{
+    for (int k = 0; k < OVERLAY_SPREAD; k++) {
+        overlays[k].add(wx, wy, w, h, sign * def->influence[k]);
     }
+}
 
-    // this cell already has something in it,
-    // don't put something unless it is removed
-    if (world[wy * world_width + wx].definition != nullptr &&
-        world[wy * world_width + wx].definition != defaultdef)
-    {
-        return;
+/**
+ * Are all tiles in the rect the default tile or null
+ */
+bool WorldData::region_free(int wx, int wy, int w, int h)
+{
+    if (wx < 0 || wy < 0 || wx + w > world_width || wy + h > world_height) {
+        return false;
     }
+    chunks_ensure(wx, wy, w, h);
+    return !occupied.any_rect(wx, wy, w, h);
+}
 
-    // can't place it, object reaches out of bounds
-    if (wx + definitions[name].worldsize.x > world_width ||
-        wy + definitions[name].worldsize.y > world_height)
-    {
-        return;
+/**
+ * Find the closest place to put something around a tile,
+ * out is where its drawer would go
+ */
+bool WorldData::find_free_spot(TileName name, int wx, int wy, int radius, ivec2& out)
+{
+    chunks_ensure(wx - radius, wy - radius, 2 * radius + definitions[name].worldsize.x, 2 * radius + definitions[name].worldsize.y);
+    return occupied.find_clear_rect(definitions[name].worldsize.x, definitions[name].worldsize.y, wx, wy, radius, out);
+}
+
+/**
+ * How many of an object are drawn from tiles in the rect,
+ * the rect may reach out of the world
+ */
+int64_t WorldData::count_in(TileName name, int wx, int wy, int w, int h) const
+{
+    return tile_counts[name].sum(wx, wy, w, h);
+}
+
+/**
+ * Place something on the the default tile or tile with a null definition.
+ * Tiles CANNOT be placed on any other tile.
+ * All tiles that the new tile takes up MUST be the default tile.
+ */
+bool WorldData::tile_place(TileName name, int wx, int wy)
+{
+    if (wx < 0 || wx >= world_width || wy < 0 || wy >= world_height) {
+        return false;
     }
 
-    // ensure all tiles in the shape of the object are the default definition
-    for (int i = wy; i < wy + definitions[name].worldsize.y; i++) {
-        for (int j = wx; j < wx + definitions[name].worldsize.x; j++) {
-            if (world[i * world_width + j].definition != nullptr &&
-                world[i * world_width + j].definition != defaultdef)
-            {
-                return;
-            }
-        }
+    // ensure all tiles in the shape of the object are the default definition,
+    // this fails when the object reaches out of bounds too
+    if (!region_free(wx, wy, definitions[name].worldsize.x, definitions[name].worldsize.y)) {
+        return false;
     }
 
     // assign drawer tile
@@ -165,12 +173,26 @@ void WorldData::tile_place(TileName name, int wx, int wy)
         for (int j = wx; j < wx + drawer->definition->worldsize.x; j++) {
             world[i * world_width + j].definition = drawer->definition;
             world[i * world_width + j].drawer = drawer->drawer;
-            world[i * world_width + j].commander = &world[(wy + drawer->definition->worldsize.y - 1) * world_width + (wx + drawer->definition->worldsize.x - 1)];
             world[i * world_width + j].world_coords = ivec2{j, i};
+            if (drawer->definition->flags & TILE_FLAG_ROAD) {
+                roads.add(j, i);
+            }
         }
     }
+    occupied.fill_rect(wx, wy, drawer->definition->worldsize.x, drawer->definition->worldsize.y, drawer->definition != defaultdef);
+    paths.set_walkable(wx, wy, drawer->definition->worldsize.x, drawer->definition->worldsize.y, drawer->definition->flags & TILE_FLAG_WALK);
+    sim.set_kind(wx, wy, drawer->definition->worldsize.x, drawer->definition->worldsize.y, sim_kind(drawer->definition));
+    influence_apply(drawer->definition, wx, wy, drawer->definition->worldsize.x, drawer->definition->worldsize.y, 1);
+    if (drawer->definition != defaultdef) {
+        tile_counts[name].add(wx, wy, 1);
+        utilities.add(wx, wy, drawer->definition->worldsize.x, drawer->definition->worldsize.y, utility_sources(drawer->definition));
+        code_set(wx, wy, (uint8_t)name);
+    }
+    journal_record(JOURNAL_PLACE, name, wx, wy, 0, 0);
+    history_commit();
 
     // done
+    return true;
 }
 
 /**
@@ -185,66 +207,1186 @@ void WorldData::tile_remove(int wx, int wy)
     }
 
     // this cell has nothing to remove
+    chunks_ensure(wx, wy, 1, 1);
     if (world[wy * world_width + wx].definition == defaultdef) {
         return;
     }
 
-    // get the drawer tile
+    // get the drawer tile, copy what it is before it gets cleared below
     TileManager *drawer = world[wy * world_width + wx].drawer;
+    TileDefinition *def = drawer->definition;
+    ivec2 origin = drawer->world_coords;
+    occupied.fill_rect(origin.x, origin.y, def->worldsize.x, def->worldsize.y, false);
+    paths.set_walkable(origin.x, origin.y, def->worldsize.x, def->worldsize.y, defaultdef->flags & TILE_FLAG_WALK);
+    sim.set_kind(origin.x, origin.y, def->worldsize.x, def->worldsize.y, sim_kind(defaultdef));
+    influence_apply(def, origin.x, origin.y, def->worldsize.x, def->worldsize.y, -1);
+    utilities.remove(origin.x, origin.y, def->worldsize.x, def->worldsize.y);
+    tile_counts[def->name].add(origin.x, origin.y, -1);
+    code_set(origin.x, origin.y, 0);
 
     // clear all assigned tiles to default tile manually
-    for (int i = drawer->world_coords.y; i < drawer->world_coords.y + drawer->definition->worldsize.y; i++) {
-        for (int j = drawer->world_coords.x; j < drawer->world_coords.x + drawer->definition->worldsize.x; j++) {
-            // tiles becomes its own drawer and commander
+    for (int i = origin.y; i < origin.y + def->worldsize.y; i++) {
+        for (int j = origin.x; j < origin.x + def->worldsize.x; j++) {
+            if (def->flags & TILE_FLAG_ROAD) {
+                roads.remove(j, i);
+            }
+            // tiles becomes its own drawer
             world[i * world_width + j].drawer = &world[i * world_width + j];
             world[i * world_width + j].definition = defaultdef;
-            world[i * world_width + j].commander = &world[i * world_width + j];
             world[i * world_width + j].world_coords = ivec2{j, i};
         }
     }
+    journal_record(JOURNAL_REMOVE, 0, wx, wy, 0, 0);
+    history_commit();
 }
 
-void WorldData::tile_draw(int wx, int wy)
+/**
+ * Write a rect that is a whole number of objects wide and tall,
+ * no checks are done. Rows of chunks are written in parallel,
+ * the occupancy bitmap starts each row on its own word so they
+ * don't share anything.
+ */
+void WorldData::region_write(TileDefinition *def, int wx, int wy, int w, int h)
 {
-    // ie. 2x2 -> 2
-    const int world_largest_tile = 2;
-    // is the tile even on the screen?
-    ivec2 screen_coords = world_to_screen(wx, wy);
-    if (screen_coords.x + world[wy * world_width + wx].definition->worldsize.x * screen_tilesize.x > world_component->x + world_largest_tile * world_component->w ||
-        screen_coords.x < world_component->x - world_largest_tile * screen_tilesize.x ||
-        screen_coords.y + world[wy * world_width + wx].definition->worldsize.y * screen_tilesize.y > world_component->y + world_largest_tile * world_component->h ||
-        screen_coords.y < world_component->y - world_largest_tile * screen_tilesize.y)
-    {
+    const int gx = def->worldsize.x;
+    const int gy = def->worldsize.y;
+    const int band_first = wy / CHUNK_SIZE;
+    const int bands = (wy + h - 1) / CHUNK_SIZE - band_first + 1;
+
+    auto write_band = [&](int band) {
+        int cy = band_first + band;
+        int y0 = std::max(wy, cy * CHUNK_SIZE);
+        int y1 = std::min(wy + h, (cy + 1) * CHUNK_SIZE);
+
+        for (int i = y0; i < y1; i++) {
+            TileManager *row = &world[i * world_width];
+            TileManager *drawer_row = &world[(wy + (i - wy) / gy * gy) * world_width];
+            for (int j = wx; j < wx + w; j++) {
+                row[j].definition = def;
+                row[j].drawer = &drawer_row[wx + (j - wx) / gx * gx];
+                row[j].world_coords = ivec2{j, i};
+            }
+        }
+        occupied.fill_rect(wx, y0, w, y1 - y0, def != defaultdef);
+
+        // each band has its own chunks, objects are coded on their drawer
+        if (decoding) {
+            return;
+        }
+        for (int cx = wx / CHUNK_SIZE; cx <= (wx + w - 1) / CHUNK_SIZE; cx++) {
+            int chunk = cy * chunks_wide + cx;
+            if (def == defaultdef && !(*chunk_table)[chunk]) {
+                continue;
+            }
+            ChunkCodes& codes = chunk_codes_write(chunk);
+            int x0 = std::max(wx, cx * CHUNK_SIZE);
+            int x1 = std::min(wx + w, (cx + 1) * CHUNK_SIZE);
+            for (int i = y0; i < y1; i++) {
+                uint8_t *row = &codes[(i - cy * CHUNK_SIZE) * CHUNK_SIZE - cx * CHUNK_SIZE];
+                for (int j = x0; j < x1; j++) {
+                    bool drawer = def != defaultdef && (i - wy) % gy == 0 && (j - wx) % gx == 0;
+                    row[j] = drawer ? (uint8_t)def->name : 0;
+                }
+            }
+        }
+    };
+
+    chunk_table_own();
+    for (int cy = band_first; cy < band_first + bands; cy++) {
+        for (int cx = wx / CHUNK_SIZE; cx <= (wx + w - 1) / CHUNK_SIZE; cx++) {
+            if (!decoding && (def != defaultdef || (*chunk_table)[cy * chunks_wide + cx])) {
+                history_touch(cy * chunks_wide + cx);
+            }
+        }
+    }
+    if (w * h >= BULK_PARALLEL_MIN) {
+        ctx.workers.parallel_for(bands, write_band);
+    }
+    else {
+        for (int band = 0; band < bands; band++) {
+            write_band(band);
+        }
+    }
+    paths.set_walkable(wx, wy, w, h, def->flags & TILE_FLAG_WALK);
+    sim.set_kind(wx, wy, w, h, sim_kind(def));
+    influence_apply(def, wx, wy, w, h, 1);
+    if (def != defaultdef) {
+        tile_counts[def->name].add_every(wx, wy, w, h, gx, gy, 1);
+        utilities.add(wx, wy, w, h, utility_sources(def));
+    }
+    else {
+        utilities.remove(wx, wy, w, h);
+    }
+
+    if (def->flags & TILE_FLAG_ROAD) {
+        for (int i = wy; i < wy + h; i++) {
+            for (int j = wx; j < wx + w; j++) {
+                roads.add(j, i);
+            }
+        }
+    }
+}
+
+/**
+ * Fill a rect with as many of an object as fit in it, side by side.
+ * Nothing is placed unless the whole area is free.
+ */
+bool WorldData::tile_fill(TileName name, int wx, int wy, int w, int h)
+{
+    TileDefinition *def = &definitions[name];
+    w = w / def->worldsize.x * def->worldsize.x;
+    h = h / def->worldsize.y * def->worldsize.y;
+    if (w <= 0 || h <= 0 || !region_free(wx, wy, w, h)) {
+        return false;
+    }
+
+    region_write(def, wx, wy, w, h);
+    journal_record(JOURNAL_FILL, name, wx, wy, w, h);
+    history_commit();
+    return true;
+}
+
+/**
+ * Place each object in order, returns how many were placed
+ */
+int WorldData::tile_place_list(const std::vector<TilePlacement>& list)
+{
+    int placed = 0;
+    history_begin();
+    for (const TilePlacement& p : list) {
+        placed += tile_place(p.name, p.wx, p.wy);
+    }
+    history_end();
+    return placed;
+}
+
+/**
+ * Remove everything in a rect, objects that hang
+ * out of the rect are removed entirely
+ */
+void WorldData::tile_clear(int wx, int wy, int w, int h)
+{
+    int x0 = std::max(wx, 0);
+    int y0 = std::max(wy, 0);
+    int x1 = std::min(wx + w, world_width);
+    int y1 = std::min(wy + h, world_height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    chunks_ensure(x0, y0, x1 - x0, y1 - y0);
+    journal_record(JOURNAL_CLEAR, 0, x0, y0, x1 - x0, y1 - y0);
+    journal_mute++;
+    history_begin();
+
+    // only objects crossing the edge of the rect reach out of it
+    auto remove_crossing = [&](int j, int i) {
+        if (!occupied.get(j, i)) {
+            return;
+        }
+        TileManager& t = world[i * world_width + j];
+        ivec2 d = t.drawer->world_coords;
+        if (d.x < x0 || d.y < y0 ||
+            d.x + t.definition->worldsize.x > x1 ||
+            d.y + t.definition->worldsize.y > y1)
+        {
+            tile_remove(j, i);
+        }
+    };
+    for (int j = x0; j < x1; j++) {
+        remove_crossing(j, y0);
+        remove_crossing(j, y1 - 1);
+    }
+    for (int i = y0; i < y1; i++) {
+        remove_crossing(x0, i);
+        remove_crossing(x1 - 1, i);
+    }
+
+    for (int i = y0; i < y1; i++) {
+        for (int j = x0; j < x1; j++) {
+            if (!occupied.get(j, i)) {
+                continue;
+            }
+            TileDefinition *def = world[i * world_width + j].definition;
+            if (def->flags & TILE_FLAG_ROAD) {
+                roads.remove(j, i);
+            }
+            influence_apply(def, j, i, 1, 1, -1);
+        }
+    }
+    // what's left is inside, drawn from inside
+    for (sumgrid& counts : tile_counts) {
+        counts.clear(x0, y0, x1 - x0, y1 - y0);
+    }
+
+    region_write(defaultdef, x0, y0, x1 - x0, y1 - y0);
+    journal_mute--;
+    history_end();
+}
+
+/**
+ * Read in the chunks of the loaded save that the rect touches, and
+ * the ones above and to the left of them, whose objects can reach in
+ */
+void WorldData::chunks_ensure(int wx, int wy, int w, int h)
+{
+    if (pending_chunks == 0 || decoding || w <= 0 || h <= 0) {
+        return;
+    }
+    int x1 = std::min(wx + w - 1, world_width - 1);
+    int y1 = std::min(wy + h - 1, world_height - 1);
+    if (x1 < 0 || y1 < 0) {
+        return;
+    }
+    int cx0 = std::max(std::max(wx, 0) / CHUNK_SIZE - 1, 0);
+    int cy0 = std::max(std::max(wy, 0) / CHUNK_SIZE - 1, 0);
+
+    decoding = true;
+    for (int cy = cy0; cy <= y1 / CHUNK_SIZE; cy++) {
+        for (int cx = cx0; cx <= x1 / CHUNK_SIZE; cx++) {
+            chunk_decode(cy * chunks_wide + cx);
+        }
+    }
+    decoding = false;
+    if (pending_chunks == 0) {
+        loaded.reset();
+    }
+}
+
+/**
+ * Place the objects of a chunk from the loaded save. Objects from
+ * chunks not read in yet never overlap them, so they can be placed
+ * before or after their neighbours.
+ */
+void WorldData::chunk_decode(int chunk)
+{
+    if (!chunk_pending[chunk]) {
+        return;
+    }
+    chunk_pending[chunk] = 0;
+    pending_chunks--;
+
+    // codes of a chunk still in the save only go in the table now,
+    // while decoding nothing placed writes them
+    std::shared_ptr<ChunkCodes> codes = (*chunk_table)[chunk];
+    std::shared_ptr<ChunkPrefetch> prefetched = std::move(chunk_prefetch[chunk]);
+    chunk_prefetch[chunk] = nullptr;
+    if (!codes && prefetched && prefetched->done && prefetched->ok && prefetched->codes && prefetched->file == loaded) {
+        codes = prefetched->codes;
+        chunk_table_own();
+        (*chunk_table)[chunk] = codes;
+    }
+    else if (!codes) {
+        codes = std::make_shared<ChunkCodes>(CHUNK_SIZE * CHUNK_SIZE, 0);
+        chunk_table_own();
+        (*chunk_table)[chunk] = codes;
+        if (!loaded->chunk_codes(chunk, codes->data())) {
+            fprintf(stderr, "Error: Chunk %d of the save is corrupt\n", chunk);
+            std::fill(codes->begin(), codes->end(), 0);
+            return;
+        }
+    }
+    const int x0 = (chunk % chunks_wide) * CHUNK_SIZE;
+    const int y0 = (chunk / chunks_wide) * CHUNK_SIZE;
+    for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++) {
+        uint8_t code = (*codes)[i];
+        if (code != 0 && code < TILE_COUNT) {
+            tile_place((TileName)code, x0 + i % CHUNK_SIZE, y0 + i / CHUNK_SIZE);
+        }
+    }
+}
+
+/**
+ * Read in a few chunks of the loaded save that nothing has needed yet,
+ * so the rest of the world catches up while it is played
+ */
+void WorldData::load_step()
+{
+    if (pending_chunks == 0) {
+        return;
+    }
+    decoding = true;
+    int n = 0;
+    while (n < LOAD_CHUNKS_PER_FRAME && !chunk_requests.empty()) {
+        int chunk = chunk_requests.back();
+        chunk_requests.pop_back();
+        chunk_requested[chunk] = 0;
+        if (chunk_pending[chunk]) {
+            chunk_decode(chunk);
+            n++;
+        }
+    }
+    // then what the camera is heading for, once its codes are ready
+    for (size_t i = 0; i < prefetch_queue.size() && n < LOAD_CHUNKS_PER_FRAME;) {
+        int chunk = prefetch_queue[i];
+        if (chunk_pending[chunk] && chunk_prefetch[chunk] && !chunk_prefetch[chunk]->done) {
+            i++;
+            continue;
+        }
+        prefetch_queue.erase(prefetch_queue.begin() + i);
+        if (chunk_pending[chunk]) {
+            chunk_decode(chunk);
+            n++;
+        }
+    }
+    decoding = false;
+    if (pending_chunks == 0) {
+        loaded.reset();
+    }
+}
+
+/**
+ * The rest of a loaded save is read in a chunk at a time in the background
+ */
+bool WorldData::load_idle()
+{
+    if (pending_chunks == 0) {
+        return false;
+    }
+    while (!chunk_pending[load_cursor]) {
+        load_cursor = (load_cursor + 1) % (int)chunk_pending.size();
+    }
+    decoding = true;
+    chunk_decode(load_cursor);
+    decoding = false;
+    if (pending_chunks == 0) {
+        loaded.reset();
+    }
+    return true;
+}
+
+/**
+ * Keep the overlays that aren't shown up to date in the background,
+ * so showing one doesn't have to recompute everything that changed
+ */
+bool WorldData::overlay_idle()
+{
+    for (int k = 0; k < OVERLAY_SPREAD; k++) {
+        if (k != overlay_shown && overlays[k].stale()) {
+            overlays[k].refresh_one();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * The save is written from a snapshot, so all that happens here is
+ * taking one, a worker encodes and writes it
+ */
+bool WorldData::world_save(const char *path, uint64_t generation)
+{
+    if (saving()) {
+        return false;
+    }
+    // the last one's snapshot may still have the file being replaced
+    if (save_job) {
+        save_job->world = WorldSnapshot{};
+    }
+    loaded_drop();
+    std::shared_ptr<SaveJob> job = std::make_shared<SaveJob>();
+    job->path = path;
+    job->generation = generation;
+    job->world = snapshot();
+
+    save_job = job;
+    ctx.workers.submit([job]() {
+        job->ok = save_write(*job);
+        job->done = true;
+    });
+    return true;
+}
+
+/**
+ * Windows can't replace a file that's mapped, so before a save the codes of
+ * the chunks still in the loaded save go in the table and it's unmapped. Only
+ * the codes are read, the chunks are still placed when they're needed.
+ */
+void WorldData::loaded_drop()
+{
+    if (!loaded) {
+        return;
+    }
+    chunk_table_own();
+    for (int c = 0; c < chunks_wide * chunks_tall; c++) {
+        std::shared_ptr<ChunkCodes>& codes = (*chunk_table)[c];
+        std::shared_ptr<ChunkPrefetch> prefetched = chunk_prefetch[c];
+        if (prefetched) {
+            // it has the file until it's read
+            while (!prefetched->done) {
+                std::this_thread::yield();
+            }
+            prefetched->file = nullptr;
+        }
+        if (!chunk_pending[c] || codes || loaded->objects(c) == 0) {
+            continue;
+        }
+        if (prefetched && prefetched->ok && prefetched->codes) {
+            codes = prefetched->codes;
+            continue;
+        }
+        codes = std::make_shared<ChunkCodes>(CHUNK_SIZE * CHUNK_SIZE, 0);
+        if (!loaded->chunk_codes(c, codes->data())) {
+            fprintf(stderr, "Error: Chunk %d of the save is corrupt\n", c);
+            std::fill(codes->begin(), codes->end(), 0);
+        }
+    }
+    loaded.reset();
+}
+
+bool WorldData::saving() const
+{
+    return save_job && !save_job->done;
+}
+
+/**
+ * Only the index is read now, everything is cleared and each chunk
+ * is read in when something first needs it or by load_step
+ */
+bool WorldData::world_load(const char *path)
+{
+    std::shared_ptr<SaveFile> file = std::make_shared<SaveFile>();
+    if (!file->open(path)) {
+        return false;
+    }
+    if (file->width != world_width || file->height != world_height || file->chunk_size != CHUNK_SIZE) {
+        fprintf(stderr, "Error: %s is a %dx%d world, not %dx%d\n", path, file->width, file->height, world_width, world_height);
+        return false;
+    }
+
+    WorldSnapshot from;
+    from.width = file->width;
+    from.height = file->height;
+    from.chunk_size = file->chunk_size;
+    from.chunks_wide = file->chunks_wide;
+    from.chunks_tall = file->chunks_tall;
+    from.chunks = std::make_shared<ChunkTable>(chunks_wide * chunks_tall);
+    from.file = file;
+    world_restore(from);
+    generation = file->generation;
+    return true;
+}
+
+WorldSnapshot WorldData::snapshot() const
+{
+    WorldSnapshot s;
+    s.width = world_width;
+    s.height = world_height;
+    s.chunk_size = CHUNK_SIZE;
+    s.chunks_wide = chunks_wide;
+    s.chunks_tall = chunks_tall;
+    s.chunks = chunk_table;
+    s.file = loaded;
+    return s;
+}
+
+/**
+ * Become what the snapshot is. The table is shared with it and everything
+ * else is cleared, chunks are placed when something first needs them or
+ * by load_step, just as they are from a save.
+ */
+bool WorldData::world_restore(const WorldSnapshot& from)
+{
+    if (!from.valid() || from.width != world_width || from.height != world_height || from.chunk_size != CHUNK_SIZE) {
+        return false;
+    }
+
+    pending_chunks = 0;
+    loaded.reset();
+    std::fill(chunk_pending.begin(), chunk_pending.end(), 0);
+    // nothing cleared needs coding, the table is replaced
+    chunk_table = std::make_shared<ChunkTable>(chunks_wide * chunks_tall);
+    std::fill(chunk_requested.begin(), chunk_requested.end(), 0);
+    chunk_requests.clear();
+    std::fill(chunk_prefetch.begin(), chunk_prefetch.end(), nullptr);
+    prefetch_queue.clear();
+
+    // what it becomes isn't an edit, the journal starts again at the next compact
+    journal.close();
+    history.clear();
+    history_before.clear();
+    journal_mute++;
+    for (int c = 0; c < chunks_wide * chunks_tall; c++) {
+        const int x0 = (c % chunks_wide) * CHUNK_SIZE;
+        const int y0 = (c / chunks_wide) * CHUNK_SIZE;
+        const int w = std::min(CHUNK_SIZE, world_width - x0);
+        const int h = std::min(CHUNK_SIZE, world_height - y0);
+        if (occupied.any_rect(x0, y0, w, h)) {
+            tile_clear(x0, y0, w, h);
+        }
+        if ((*from.chunks)[c] || (from.file && from.file->objects(c) > 0)) {
+            chunk_pending[c] = 1;
+            pending_chunks++;
+        }
+    }
+    journal_mute--;
+    // copied before it's written, as long as from has it
+    chunk_table = std::const_pointer_cast<ChunkTable>(from.chunks);
+    load_cursor = 0;
+    if (pending_chunks > 0) {
+        loaded = from.file;
+    }
+    return true;
+}
+
+void WorldData::history_begin()
+{
+    history_depth++;
+}
+
+void WorldData::history_end()
+{
+    history_depth--;
+    history_commit();
+}
+
+/**
+ * Keep a chunk as it was before the step first writes to it, holding
+ * it makes the write copy it rather than change it
+ */
+void WorldData::history_touch(int chunk)
+{
+    if (history_replaying || decoding || history_marks[chunk] == history_step) {
+        return;
+    }
+    history_marks[chunk] = history_step;
+    history_before.emplace_back(chunk, (*chunk_table)[chunk]);
+}
+
+void WorldData::history_commit()
+{
+    if (history_depth > 0 || history_before.empty()) {
+        return;
+    }
+    HistoryStep step;
+    for (const auto& before : history_before) {
+        HistoryChunk hc{before.first, {}};
+        if (history_delta(before.second.get(), (*chunk_table)[before.first].get(), CHUNK_SIZE * CHUNK_SIZE, hc.delta)) {
+            step.chunks.push_back(std::move(hc));
+        }
+    }
+    history_before.clear();
+    history_step++;
+    if (!step.chunks.empty()) {
+        history.push(std::move(step));
+    }
+}
+
+bool WorldData::undo()
+{
+    if (history_depth > 0) {
+        return false;
+    }
+    const HistoryStep *step = history.undo();
+    if (!step) {
+        return false;
+    }
+    history_apply(*step);
+    return true;
+}
+
+bool WorldData::redo()
+{
+    if (history_depth > 0) {
+        return false;
+    }
+    const HistoryStep *step = history.redo();
+    if (!step) {
+        return false;
+    }
+    history_apply(*step);
+    return true;
+}
+
+/**
+ * Take the chunks of a step to the codes on its other side. Everything
+ * that goes is removed before anything is placed, as the objects on
+ * either side can overlap the other side's.
+ */
+void WorldData::history_apply(const HistoryStep& step)
+{
+    std::vector<std::vector<TilePlacement>> removes(step.chunks.size());
+    std::vector<std::vector<TilePlacement>> places(step.chunks.size());
+    ChunkCodes target(CHUNK_SIZE * CHUNK_SIZE);
+    for (size_t k = 0; k < step.chunks.size(); k++) {
+        const int chunk = step.chunks[k].chunk;
+        const int x0 = (chunk % chunks_wide) * CHUNK_SIZE;
+        const int y0 = (chunk / chunks_wide) * CHUNK_SIZE;
+        chunks_ensure(x0, y0, CHUNK_SIZE, CHUNK_SIZE);
+        const ChunkCodes *codes = (*chunk_table)[chunk].get();
+        if (codes) {
+            target = *codes;
+        }
+        else {
+            std::fill(target.begin(), target.end(), 0);
+        }
+        if (!history_delta_apply(step.chunks[k].delta, target.data(), CHUNK_SIZE * CHUNK_SIZE)) {
+            fprintf(stderr, "Error: History of chunk %d is corrupt\n", chunk);
+            continue;
+        }
+        for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++) {
+            uint8_t now = codes ? (*codes)[i] : 0;
+            if (now == target[i]) {
+                continue;
+            }
+            if (now != 0) {
+                removes[k].push_back(TilePlacement{(TileName)now, x0 + i % CHUNK_SIZE, y0 + i / CHUNK_SIZE});
+            }
+            if (target[i] != 0 && target[i] < TILE_COUNT) {
+                places[k].push_back(TilePlacement{(TileName)target[i], x0 + i % CHUNK_SIZE, y0 + i / CHUNK_SIZE});
+            }
+        }
+    }
+
+    history_replaying = true;
+    history_edits(removes, false);
+    history_edits(places, true);
+    history_replaying = false;
+}
+
+/**
+ * Lists of each chunk that together are a whole grid of one kind of
+ * object, as a fill leaves, are one fill or clear. So is each list that
+ * is one on its own, anything else is an edit per object.
+ */
+void WorldData::history_edits(const std::vector<std::vector<TilePlacement>>& lists, bool place)
+{
+    std::vector<TilePlacement> all;
+    for (const std::vector<TilePlacement>& list : lists) {
+        all.insert(all.end(), list.begin(), list.end());
+    }
+    if (history_grid_edit(all, place)) {
+        return;
+    }
+    for (const std::vector<TilePlacement>& list : lists) {
+        if (history_grid_edit(list, place)) {
+            continue;
+        }
+        for (const TilePlacement& p : list) {
+            if (place) {
+                tile_place(p.name, p.wx, p.wy);
+            }
+            else {
+                tile_remove(p.wx, p.wy);
+            }
+        }
+    }
+}
+
+bool WorldData::history_grid_edit(const std::vector<TilePlacement>& list, bool place)
+{
+    if (list.size() < 2) {
+        return false;
+    }
+    const TileName name = list[0].name;
+    const int gx = definitions[name].worldsize.x;
+    const int gy = definitions[name].worldsize.y;
+    int x0 = list[0].wx;
+    int y0 = list[0].wy;
+    int x1 = x0;
+    int y1 = y0;
+    for (const TilePlacement& p : list) {
+        if (p.name != name) {
+            return false;
+        }
+        x0 = std::min(x0, p.wx);
+        y0 = std::min(y0, p.wy);
+        x1 = std::max(x1, p.wx);
+        y1 = std::max(y1, p.wy);
+    }
+    for (const TilePlacement& p : list) {
+        if ((p.wx - x0) % gx != 0 || (p.wy - y0) % gy != 0) {
+            return false;
+        }
+    }
+    // no two are on the same tile, so as many as the grid has fill it
+    const int w = x1 - x0 + gx;
+    const int h = y1 - y0 + gy;
+    if ((size_t)(w / gx) * (h / gy) != list.size()) {
+        return false;
+    }
+
+    if (place) {
+        tile_fill(name, x0, y0, w, h);
+    }
+    else {
+        tile_clear(x0, y0, w, h);
+    }
+    return true;
+}
+
+void WorldData::chunk_table_own()
+{
+    if (chunk_table.use_count() > 1) {
+        chunk_table = std::make_shared<ChunkTable>(*chunk_table);
+    }
+}
+
+ChunkCodes& WorldData::chunk_codes_write(int chunk)
+{
+    std::shared_ptr<ChunkCodes>& codes = (*chunk_table)[chunk];
+    if (!codes) {
+        codes = std::make_shared<ChunkCodes>(CHUNK_SIZE * CHUNK_SIZE, 0);
+    }
+    else if (codes.use_count() > 1) {
+        codes = std::make_shared<ChunkCodes>(*codes);
+    }
+    return *codes;
+}
+
+void WorldData::code_set(int wx, int wy, uint8_t code)
+{
+    int chunk = wy / CHUNK_SIZE * chunks_wide + wx / CHUNK_SIZE;
+    if (decoding || (code == 0 && !(*chunk_table)[chunk])) {
+        return;
+    }
+    chunk_table_own();
+    history_touch(chunk);
+    chunk_codes_write(chunk)[(wy % CHUNK_SIZE) * CHUNK_SIZE + wx % CHUNK_SIZE] = code;
+}
+
+bool WorldData::chunk_request(int chunk)
+{
+    if (!chunk_pending[chunk]) {
+        return true;
+    }
+    if (!chunk_requested[chunk]) {
+        chunk_requested[chunk] = 1;
+        chunk_requests.push_back(chunk);
+    }
+    return false;
+}
+
+/**
+ * Guess where the camera will be from how it has been panning and
+ * zooming, and have workers read in the codes of the chunks that come
+ * into view there. They're placed after what's on screen, so by the
+ * time they're on screen themselves there's nothing left to wait for.
+ */
+void WorldData::prefetch_step()
+{
+    const float dt = (float)ctx.delta_time;
+    if (dt > 0.0f && zoom_last > 0) {
+        // smoothed, a single frame's jump says little
+        const float k = 0.3f;
+        camera_velocity.x += k * ((screen_offset.x - camera_last.x) / dt - camera_velocity.x);
+        camera_velocity.y += k * ((screen_offset.y - camera_last.y) / dt - camera_velocity.y);
+        zoom_velocity += k * ((screen_tilesize.x - zoom_last) / dt - zoom_velocity);
+    }
+    camera_last = screen_offset;
+    zoom_last = screen_tilesize.x;
+    if (pending_chunks == 0) {
+        return;
+    }
+
+    ivec2 offset{ screen_offset.x + (int)(camera_velocity.x * PREFETCH_AHEAD), screen_offset.y + (int)(camera_velocity.y * PREFETCH_AHEAD) };
+    int tw = std::max(screen_tilesize.x + (int)(zoom_velocity * PREFETCH_AHEAD), 4);
+    int dmin, dmax, emin, emax;
+    view_bounds(offset, ivec2{ tw, tw * screen_tilesize.y / screen_tilesize.x }, tile_reach, dmin, dmax, emin, emax);
+
+    int handed = 0;
+    for (int cy = 0; cy < chunks_tall && handed < PREFETCH_PER_FRAME; cy++) {
+        // the chunks the rows of this chunk row cover between them
+        int lo = world_width;
+        int hi = -1;
+        for (int wy = cy * CHUNK_SIZE; wy < std::min((cy + 1) * CHUNK_SIZE, world_height); wy++) {
+            lo = std::min(lo, std::max({0, dmin - wy, emin + wy}));
+            hi = std::max(hi, std::min({world_width - 1, dmax - wy, emax + wy}));
+        }
+        if (lo > hi) {
+            continue;
+        }
+        for (int cx = lo / CHUNK_SIZE; cx <= hi / CHUNK_SIZE && handed < PREFETCH_PER_FRAME; cx++) {
+            int c = cy * chunks_wide + cx;
+            if (!chunk_pending[c] || chunk_requested[c] || chunk_prefetch[c]) {
+                continue;
+            }
+            std::shared_ptr<ChunkPrefetch> p = std::make_shared<ChunkPrefetch>();
+            p->file = loaded;
+            chunk_prefetch[c] = p;
+            prefetch_queue.push_back(c);
+            handed++;
+            if ((*chunk_table)[c] || !loaded) {
+                p->done = true;
+                continue;
+            }
+            ctx.workers.submit([p, c]() {
+                p->codes = std::make_shared<ChunkCodes>(p->file->chunk_size * p->file->chunk_size);
+                p->ok = p->file->chunk_codes(c, p->codes->data());
+                p->done = true;
+            });
+        }
+    }
+}
+
+/**
+ * Chunks on screen that aren't placed yet are covered over until they
+ * are, in strips like the overlays as SDL can't fill a diamond
+ */
+void WorldData::placeholder_draw()
+{
+    const int tw = screen_tilesize.x;
+    const int th = screen_tilesize.y;
+    frame_vector<SDL_Rect> placeholder_rects;
+    for (int c : placeholders) {
+        if (!chunk_pending[c]) {
+            continue;
+        }
+        const int x0 = (c % chunks_wide) * CHUNK_SIZE;
+        const int y0 = (c / chunks_wide) * CHUNK_SIZE;
+        const int w = std::min(CHUNK_SIZE, world_width - x0);
+        const int h = std::min(CHUNK_SIZE, world_height - y0);
+        // from its top corner the chunk reaches out to its right and left
+        // corners, then back in to its bottom one
+        ivec2 top = world_to_screen(x0, y0);
+        top.x += tw / 2;
+        const int right = w * tw / 2;
+        const int right_down = w * th / 2;
+        const int left = h * tw / 2;
+        const int left_down = h * th / 2;
+        const int tall = right_down + left_down;
+        for (int y = 0; y < tall; y += OVERLAY_BAND) {
+            int mid = std::min(y + OVERLAY_BAND / 2, tall - 1);
+            int xl = mid < left_down ? top.x - mid * left / left_down : top.x - left + (mid - left_down) * right / right_down;
+            int xr = mid < right_down ? top.x + mid * right / right_down : top.x + right - (mid - right_down) * left / left_down;
+            if (xr > xl) {
+                placeholder_rects.push_back(SDL_Rect{ xl, top.y + y, xr - xl, std::min(OVERLAY_BAND, tall - y) });
+            }
+        }
+    }
+    if (!placeholder_rects.empty()) {
+        SDL_Color c = Gray;
+        c.a = 192;
+        ctx.draw_rects_fill(c, placeholder_rects.data(), (int)placeholder_rects.size());
+    }
+}
+
+std::string WorldData::journal_path(uint64_t g) const
+{
+    return std::string(SAVE_PATH) + ".journal" + std::to_string(g);
+}
+
+void WorldData::journal_record(JournalOp op, int name, int wx, int wy, int w, int h)
+{
+    if (journal_mute > 0 || decoding || !journal.is_open()) {
+        return;
+    }
+    journal.record(JournalRecord{op, name, wx, wy, w, h});
+}
+
+/**
+ * Load the snapshot, then replay the journal of its generation and any
+ * after it, a crash can leave a newer journal whose snapshot never got
+ * written. Whatever was replayed is then made into a new snapshot.
+ */
+bool WorldData::recover()
+{
+    if (forked || saving()) {
+        return false;
+    }
+    journal.close();
+    journal_mute++;
+    if (!world_load(SAVE_PATH)) {
+        generation = 0;
+        pending_chunks = 0;
+        loaded.reset();
+        std::fill(chunk_pending.begin(), chunk_pending.end(), 0);
+        if (occupied.any_rect(0, 0, world_width, world_height)) {
+            tile_clear(0, 0, world_width, world_height);
+        }
+        demo_place();
+    }
+    journal_first = generation;
+
+    uint64_t g = generation;
+    uint64_t base;
+    std::vector<JournalRecord> records;
+    bool replayed = false;
+    while (Journal::replay(journal_path(g), base, records) && base == g) {
+        for (const JournalRecord& r : records) {
+            if ((r.op == JOURNAL_PLACE || r.op == JOURNAL_FILL) && (r.name <= 0 || r.name >= TILE_COUNT)) {
+                continue;
+            }
+            switch (r.op) {
+            case JOURNAL_PLACE:
+                tile_place((TileName)r.name, r.x, r.y);
+                break;
+            case JOURNAL_REMOVE:
+                tile_remove(r.x, r.y);
+                break;
+            case JOURNAL_FILL:
+                tile_fill((TileName)r.name, r.x, r.y, r.w, r.h);
+                break;
+            case JOURNAL_CLEAR:
+                tile_clear(r.x, r.y, r.w, r.h);
+                break;
+            }
+        }
+        replayed = replayed || !records.empty();
+        records.clear();
+        g++;
+    }
+    journal_mute--;
+    history.clear();
+
+    if (replayed || g > generation + 1) {
+        generation = g - 1;
+        compact();
+    }
+    else {
+        journal.open(journal_path(generation), generation);
+    }
+    return true;
+}
+
+/**
+ * Once a snapshot is written the journals before it are in it,
+ * and a journal grown too long is folded into a new one
+ */
+void WorldData::journal_step()
+{
+    if (compacting && !saving()) {
+        compacting = false;
+        if (save_job->ok) {
+            for (; journal_first < generation; journal_first++) {
+                remove(journal_path(journal_first).c_str());
+            }
+        }
+    }
+    if (journal.size() > JOURNAL_COMPACT_BYTES) {
+        compact();
+    }
+}
+
+/**
+ * Journal from here on top of a new generation and write that generation's
+ * snapshot. Until it's written the old snapshot and journals still hold
+ * everything, so they are only removed once it is.
+ */
+void WorldData::compact()
+{
+    if (forked || saving()) {
+        return;
+    }
+    uint64_t next = generation + 1;
+    if (!journal.open(journal_path(next), next) || !world_save(SAVE_PATH, next)) {
         return;
     }
+    generation = next;
+    compacting = true;
+}
 
+/**
+ * Queue the tile to be drawn, multi-tile objects are queued
+ * by their drawer. Objects are drawn in order of the center
+ * of their tile closest to the bottom of the screen.
+ */
+void WorldData::tile_draw(int wx, int wy)
+{
     if (wx < 0 || wx >= world_width || wy < 0 || wy >= world_height) {
         return;
     }
 
-    // don't draw the tile if it is not the commander
-    if (&world[wy * world_width + wx] != world[wy * world_width + wx].commander) {
+    TileManager& tile = world[wy * world_width + wx];
+    if (tile.drawer != &tile) {
         return;
     }
 
-    // The current coords are the lowest on screen, get the coords of the highest on screen
-    // then calculate the offset of the top left corner of the tile image for drawing
-    ivec2& dw = world[wy * world_width + wx].commander->drawer->world_coords;
-    screen_coords = world_to_screen(dw.x, dw.y);
-    int& id = world[dw.y * world_width + dw.x].definition->id;
+    ivec2 screen_coords = world_to_screen(wx, wy);
+    TileDefinition *def = tile.definition;
 
     int& w  = screen_tilesize.x;
     int& h  = screen_tilesize.y;
-    int& gx = world[dw.y * world_width + dw.x].definition->worldsize.x;
-    int& gy = world[dw.y * world_width + dw.x].definition->worldsize.y;
-    int& gz = world[dw.y * world_width + dw.x].definition->worldsize.z;
+    int& gx = def->worldsize.x;
+    int& gy = def->worldsize.y;
+    int& gz = def->worldsize.z;
 
     int sx = screen_coords.x - w / 2 * gy + w / 2;
     int sy = screen_coords.y - (gz - 1) * h / 2;
     int sw = w / 2 * gy + w / 2 * gx;
     int sh = h / 2 * gx + h / 2 * gy + (gz - 1) * h / 2;
 
-    ctx.draw_image(id, SDL_Rect{ sx, sy, sw, sh });
+    int depth = (wx + gx + wy + gy - 1) * DEPTH_STEPS;
+    int layer = (def->flags & TILE_FLAG_GROUND) ? LAYER_GROUND : LAYER_OBJECTS;
+    draws.push(layer, depth, def->id, SDL_Rect{ sx, sy, sw, sh }, def->opaque);
+}
+
+/**
+ * Queue an image standing at a point in the world, the point is
+ * the bottom middle of the image. Size is in tiles.
+ */
+void WorldData::sprite_draw(int id, float wx, float wy, float w, float h)
+{
+    ivec2 feet = world_point_to_screen(wx, wy);
+    int sw = (int)(w * screen_tilesize.x);
+    int sh = (int)(h * screen_tilesize.y);
+
+    int depth = (int)((wx + wy) * DEPTH_STEPS);
+    draws.push(LAYER_OBJECTS, depth, id, SDL_Rect{ feet.x - sw / 2, feet.y - sh, sw, sh }, ctx.image_mask(id));
+}
+
+entity WorldData::agent_spawn(TileName look, float wx, float wy, float vx, float vy)
+{
+    entity e = agents.create();
+    agents.add(e, Position{ wx, wy });
+    agents.add(e, Velocity{ vx, vy });
+    agents.add(e, Sprite{ definitions[look].id, 0.25f, 0.5f });
+    agent_cells.insert(e.index, wx, wy);
+    return e;
+}
+
+void WorldData::agent_remove(entity e)
+{
+    if (agents.alive(e)) {
+        agent_cells.erase(e.index);
+        agents.destroy(e);
+    }
+}
+
+/**
+ * Agents walk in a straight line and turn back
+ * from anything they can't walk on
+ */
+void WorldData::agents_update(float dt)
+{
+    agents.each<Position, Velocity>(ctx.workers, [this, dt](entity, Position& p, Velocity& v) {
+        float nx = p.x + v.x * dt;
+        float ny = p.y + v.y * dt;
+        if (paths.walkable((int)std::floor(nx), (int)std::floor(p.y))) {
+            p.x = nx;
+        }
+        else {
+            v.x = -v.x;
+        }
+        if (paths.walkable((int)std::floor(p.x), (int)std::floor(ny))) {
+            p.y = ny;
+        }
+        else {
+            v.y = -v.y;
+        }
+    });
+
+    // most agents stay in their cell, which only updates their position
+    agents.each<Position>([this](entity e, Position& p) {
+        agent_cells.move(e.index, p.x, p.y);
+    });
+}
+
+/**
+ * Tiles within reach of the world component, rows of the
+ * screen are wx + wy, columns are wx - wy, both in half tiles
+ */
+void WorldData::visible_bounds(int reach, int& dmin, int& dmax, int& emin, int& emax)
+{
+    view_bounds(screen_offset, screen_tilesize, reach, dmin, dmax, emin, emax);
+}
+
+/**
+ * The same for the camera somewhere else
+ */
+void WorldData::view_bounds(ivec2 offset, ivec2 tilesize, int reach, int& dmin, int& dmax, int& emin, int& emax)
+{
+    const SDL_Rect& view = *ctx.components.rect(world_component);
+    ivec2 base{ world_origin.x * tilesize.x + offset.x, world_origin.y * tilesize.y + offset.y };
+    dmin = floor_div(view.y - base.y, tilesize.y / 2) - reach - 2;
+    dmax = floor_div(view.y + view.h - base.y, tilesize.y / 2) + reach;
+    emin = floor_div(view.x - base.x, tilesize.x / 2) - reach - 2;
+    emax = floor_div(view.x + view.w - base.x, tilesize.x / 2) + reach;
+}
+
+/**
+ * Can a sprite standing on this point be seen in the world component
+ */
+bool WorldData::sprite_visible(float wx, float wy, float w, float h)
+{
+    ivec2 feet = world_point_to_screen(wx, wy);
+    int sw = (int)(w * screen_tilesize.x);
+    int sh = (int)(h * screen_tilesize.y);
+    const SDL_Rect& view = *ctx.components.rect(world_component);
+    return feet.x + sw / 2 >= view.x && feet.x - sw / 2 < view.x + view.w &&
+           feet.y >= view.y && feet.y - sh < view.y + view.h;
+}
+
+void WorldData::agents_draw()
+{
+    agents.each<Position, Sprite>([&](entity, Position& p, Sprite& s) {
+        if (sprite_visible(p.x, p.y, s.w, s.h)) {
+            sprite_draw(s.id, p.x, p.y, s.w, s.h);
+        }
+    });
+}
+
+void WorldData::traffic_draw()
+{
+    frame_vector<vec2<float>> vehicle_spots;
+    traffic.vehicle_positions(vehicle_spots);
+    for (auto& v : vehicle_spots) {
+        if (sprite_visible(v.x, v.y, 0.3f, 0.3f)) {
+            sprite_draw(definitions[TILE_TEST_11].id, v.x, v.y, 0.3f, 0.3f);
+        }
+    }
+}
+
+/**
+ * Shade the ground of every visible tile by the overlay being shown.
+ * SDL has no way to fill a diamond, so each one is stacked strips,
+ * and the strips of every tile with the same shade go in one call.
+ */
+void WorldData::overlay_draw()
+{
+    if (overlay_shown < 0) {
+        return;
+    }
+    if (overlay_shown < OVERLAY_SPREAD) {
+        overlays[overlay_shown].refresh(ctx.workers);
+    }
+    frame_vector<SDL_Rect> overlay_rects[OVERLAY_LEVELS]; // by shade
+
+    const int tw = screen_tilesize.x;
+    const int th = screen_tilesize.y;
+    int dmin, dmax, emin, emax;
+    visible_bounds(0, dmin, dmax, emin, emax);
+    for (int wy = 0; wy < world_height; wy++) {
+        int xmin = std::max({0, dmin - wy, emin + wy});
+        int xmax = std::min({world_width - 1, dmax - wy, emax + wy});
+        for (int wx = xmin; wx <= xmax; wx++) {
+            int v = overlay_shown == OVERLAY_LAND_VALUE ? sim.get(SIM_VALUE, wx, wy) : overlays[overlay_shown].get(wx, wy);
+            int level = v * OVERLAY_LEVELS / 256;
+            if (level == 0) {
+                continue;
+            }
+            ivec2 corner = world_to_screen(wx, wy);
+            for (int y = 0; y < th; y += OVERLAY_BAND) {
+                // half as wide as the diamond is across the middle of the strip
+                int mid = std::min(y + OVERLAY_BAND / 2, th - 1);
+                int half = (tw / 2) * (th / 2 - std::abs(mid - th / 2)) / (th / 2);
+                if (half > 0) {
+                    overlay_rects[level].push_back(SDL_Rect{ corner.x + tw / 2 - half, corner.y + y, half * 2, std::min(OVERLAY_BAND, th - y) });
+                }
+            }
+        }
+    }
+
+    static const SDL_Color shades[OVERLAY_COUNT] = { Brown, Orange, Aqua, Lime };
+    for (int level = 1; level < OVERLAY_LEVELS; level++) {
+        if (overlay_rects[level].empty()) {
+            continue;
+        }
+        SDL_Color c = shades[overlay_shown];
+        c.a = (uint8_t)(32 + level * 12);
+        ctx.draw_rects_fill(c, overlay_rects[level].data(), (int)overlay_rects[level].size());
+    }
+}
+
+/**
+ * Draw everything queued this frame. Items are walked front to back
+ * first so that anything entirely behind opaque items is never drawn.
+ */
+void WorldData::tile_draw_flush()
+{
+    draws.sort();
+    draws.cull(occluder);
+    ctx.draw_list(draws);
+    draws.clear();
 }
 
 ivec2 WorldData::world_to_screen(int wx, int wy)
@@ -255,30 +1397,87 @@ ivec2 WorldData::world_to_screen(int wx, int wy)
     };
 }
 
+/**
+ * Unlike world_to_screen, which gives the corner of a tile's image,
+ * this gives the pixel a point on the ground is drawn at
+ */
+ivec2 WorldData::world_point_to_screen(float wx, float wy)
+{
+    return ivec2{
+        (world_origin.x * screen_tilesize.x) + (int)((wx - wy) * (screen_tilesize.x / 2)) + screen_tilesize.x / 2 + screen_offset.x,
+        (world_origin.y * screen_tilesize.y) + (int)((wx + wy) * (screen_tilesize.y / 2)) + screen_offset.y
+    };
+}
+
 void WorldData::setup()
 {
+    // order in which they appear
+    world_component = ctx.component_add(0, (int)(ctx.screen_height * 0.1), ctx.screen_width, (int)(ctx.screen_height * 0.9));
+    menu_component = ctx.component_add(0, 0, ctx.screen_width, (int)(ctx.screen_height * 0.1));
+
+    idle_jobs.push_back(ctx.background.add([this]() { return load_idle(); }));
+    idle_jobs.push_back(ctx.background.add([this]() { return overlay_idle(); }));
+
     // LOAD IMAGES IN THE SAME ORDER AS enum TileName
-    tile_load(TILE_GRASS, 1, 1, 1, "assets/tile_grass_1x1.png");
+    tile_load(TILE_GRASS, 1, 1, 1, "assets/tile_grass_1x1.png", TILE_FLAG_GROUND | TILE_FLAG_WALK);
     tile_load(TILE_BUILDING_TENT, 2, 2, 1, "assets/buildings_tent_2x2.png");
     tile_load(TILE_HIGHLIGHT_MOUSE, 1, 1, 1, "assets/hilite_mouse_1x1.png");
-    tile_load(TILE_ROAD_DIRT_STRAIGHT_NS, 1, 1, 1, "assets/road_dirt_straight_ns_1x1.png");
-    tile_load(TILE_ROAD_DIRT_CORNER_NE, 1, 1, 1, "assets/road_dirt_corner_ne_1x1.png");
-    tile_load(TILE_ROAD_DIRT_CORNER_SE, 1, 1, 1, "assets/road_dirt_corner_se_1x1.png");
-    tile_load(TILE_ROAD_DIRT_CORNER_SW, 1, 1, 1, "assets/road_dirt_corner_sw_1x1.png");
-    tile_load(TILE_ROAD_DIRT_CORNER_NW, 1, 1, 1, "assets/road_dirt_corner_nw_1x1.png");
+    tile_load(TILE_ROAD_DIRT_STRAIGHT_NS, 1, 1, 1, "assets/road_dirt_straight_ns_1x1.png", TILE_FLAG_GROUND | TILE_FLAG_ROAD | TILE_FLAG_WALK);
+    tile_load(TILE_ROAD_DIRT_CORNER_NE, 1, 1, 1, "assets/road_dirt_corner_ne_1x1.png", TILE_FLAG_GROUND | TILE_FLAG_ROAD | TILE_FLAG_WALK);
+    tile_load(TILE_ROAD_DIRT_CORNER_SE, 1, 1, 1, "assets/road_dirt_corner_se_1x1.png", TILE_FLAG_GROUND | TILE_FLAG_ROAD | TILE_FLAG_WALK);
+    tile_load(TILE_ROAD_DIRT_CORNER_SW, 1, 1, 1, "assets/road_dirt_corner_sw_1x1.png", TILE_FLAG_GROUND | TILE_FLAG_ROAD | TILE_FLAG_WALK);
+    tile_load(TILE_ROAD_DIRT_CORNER_NW, 1, 1, 1, "assets/road_dirt_corner_nw_1x1.png", TILE_FLAG_GROUND | TILE_FLAG_ROAD | TILE_FLAG_WALK);
     tile_load(TILE_TEST_11, 1, 1, 1, "assets/test_1x1.png");
     tile_load(TILE_TEST_22, 2, 2, 1, "assets/test_2x2.png");
     tile_load(TILE_TEST_31, 3, 1, 1, "assets/test_3x1.png");
-    tile_load(TILE_TEST_224, 2, 2, 4, "assets/test_2x2x4.png");
+    tile_load(TILE_TEST_224, 2, 2, 4, "assets/test_2x2x4.png", TILE_FLAG_POWER | TILE_FLAG_WATER);
+
+    // what each kind of tile spreads around it
+    tile_influence(TILE_BUILDING_TENT, OVERLAY_NOISE, 120);
+    tile_influence(TILE_BUILDING_TENT, OVERLAY_COVERAGE, 200);
+    for (TileName road : { TILE_ROAD_DIRT_STRAIGHT_NS, TILE_ROAD_DIRT_CORNER_NE, TILE_ROAD_DIRT_CORNER_SE, TILE_ROAD_DIRT_CORNER_SW, TILE_ROAD_DIRT_CORNER_NW }) {
+        tile_influence(road, OVERLAY_NOISE, 40);
+        tile_influence(road, OVERLAY_POLLUTION, 30);
+    }
+    tile_influence(TILE_TEST_224, OVERLAY_POLLUTION, 200);
 
     // fill the world with the DEFAULT TILE DEFINITION
     // set the world_coords for each tile manager
-    for (int i = 0; i < world_height; i++) {
-        for (int j = 0; j < world_width; j++) {
-            tile_place(defaultdef->name, j, i);
-        }
+    tile_fill(defaultdef->name, 0, 0, world_width, world_height);
+
+    // carry on from the last save and its journals, or start from the demo map
+    recover();
+
+    // a few people wandering around
+    for (int i = 0; i < 8; i++) {
+        agent_spawn(TILE_TEST_11, 2.5f + i, 20.5f, 0.5f * (i % 3 - 1), 0.5f * ((i + 1) % 3 - 1));
+    }
+
+}
+
+/**
+ * Set up as a what-if copy of live from a snapshot of it, instead of with
+ * setup. The tiles live loaded are shared, nothing is added to ctx and the
+ * save and its journals are never touched, so a fork can be made and
+ * stepped on a worker while the game goes on. Nothing reads the rest of
+ * the snapshot in the background here, so every chunk is placed now.
+ */
+bool WorldData::fork(const WorldData& live, const WorldSnapshot& from)
+{
+    forked = true;
+    std::copy(live.definitions, live.definitions + TILE_COUNT, definitions);
+    tile_reach = live.tile_reach;
+    tile_fill(defaultdef->name, 0, 0, world_width, world_height);
+    if (!world_restore(from)) {
+        return false;
     }
+    chunks_ensure(0, 0, world_width, world_height);
+    loaded.reset();
+    return true;
+}
 
+void WorldData::demo_place()
+{
     tile_place(TILE_BUILDING_TENT, 2, 0);
     tile_place(TILE_ROAD_DIRT_STRAIGHT_NS, 3, 3);
     tile_place(TILE_ROAD_DIRT_STRAIGHT_NS, 3, 4);
@@ -302,10 +1501,31 @@ void WorldData::setup()
     tile_place(TILE_TEST_224, 1, 7);
     tile_place(TILE_TEST_31, 6, 1);
 
+    // and a few carts on the roads
+    traffic.spawn(3, 4, 1);
+    traffic.spawn(5, 6, 2);
+    traffic.spawn(6, 8, 3);
+}
+
+/**
+ * Everything that goes on in the world by itself, without drawing or
+ * input. A fork is moved on with this alone.
+ */
+void WorldData::step(float dt)
+{
+    load_step();
+    journal_step();
+    path_queries.update(paths);
+    agents_update(dt);
+    traffic.update(dt);
+    sim.update(dt);
 }
 
 void WorldData::update()
 {
+    prefetch_step();
+    step((float)ctx.delta_time);
+
     // TODO: Actually have a mouse thingy
     ivec2 mouse{ ctx.mouse.x, ctx.mouse.y };
     ivec2 mouse_cell{ (mouse.x - screen_offset.x) / screen_tilesize.x, (mouse.y - screen_offset.y) / screen_tilesize.y };
@@ -343,21 +1563,55 @@ void WorldData::update()
         mouse_selected.add(1, 0);
     }
 
+    // only queue the cells with sprites that can reach into the world component,
+    // their chunks that aren't placed yet are asked for and covered over
+    placeholders.clear();
+    int ask_row = -1;
+    int ask_lo = 0;
+    int ask_hi = -1;
+    int dmin, dmax, emin, emax;
+    visible_bounds(tile_reach, dmin, dmax, emin, emax);
     for (int wy = 0; wy < world_height; wy++) {
-        for (int wx = 0; wx < world_width; wx++) {
+        int xmin = std::max({0, dmin - wy, emin + wy});
+        int xmax = std::min({world_width - 1, dmax - wy, emax + wy});
+        if (xmin > xmax) {
+            continue;
+        }
+        // the rows of a chunk row cover one run of chunks between them
+        if (wy / CHUNK_SIZE != ask_row) {
+            ask_row = wy / CHUNK_SIZE;
+            ask_lo = 0;
+            ask_hi = -1;
+        }
+        for (int cx = xmin / CHUNK_SIZE; cx <= xmax / CHUNK_SIZE; cx++) {
+            if (cx >= ask_lo && cx <= ask_hi) {
+                continue;
+            }
+            int c = ask_row * chunks_wide + cx;
+            if (!chunk_request(c)) {
+                placeholders.push_back(c);
+            }
+        }
+        ask_lo = ask_lo > ask_hi ? xmin / CHUNK_SIZE : std::min(ask_lo, xmin / CHUNK_SIZE);
+        ask_hi = std::max(ask_hi, xmax / CHUNK_SIZE);
+        for (int wx = xmin; wx <= xmax; wx++) {
             tile_draw(wx, wy);
         }
     }
+    agents_draw();
+    traffic_draw();
 
     static int ox = 0;
     static int oy = 0;
     static int state = 0;
 
     // if another item is above, world component's focus is reset
-    if (world_component->mouse_hovering) {
+    if (ctx.components.flags(world_component) & COMPONENT_HOVERING) {
         ivec2 screen_selected_tile = world_to_screen(mouse_selected.x, mouse_selected.y);
         if (mouse_selected.x >= 0 && mouse_selected.x < world_width && mouse_selected.y >= 0 && mouse_selected.y < world_height) {
-            ctx.draw_image(TILE_HIGHLIGHT_MOUSE, SDL_Rect{ screen_selected_tile.x, screen_selected_tile.y, screen_tilesize.x, screen_tilesize.y });
+            // the tile's own depth, 0 would stretch the sort over every depth up to the view
+            int depth = (mouse_selected.x + mouse_selected.y + 1) * DEPTH_STEPS;
+            draws.push(LAYER_OVERLAY, depth, definitions[TILE_HIGHLIGHT_MOUSE].id, SDL_Rect{ screen_selected_tile.x, screen_selected_tile.y, screen_tilesize.x, screen_tilesize.y }, 0);
             //printf("Mouse: (%d, %d)\r", mouse_selected.x, mouse_selected.y);
         }
 
@@ -423,12 +1677,32 @@ void WorldData::update()
         }
     }
 
+    tile_draw_flush();
+    overlay_draw();
+    placeholder_draw();
+
     if (ctx.check_key_invalidate(SDL_SCANCODE_SPACE)) {
         screen_offset = ivec2{0, 0};
     }
+    if (ctx.check_key_invalidate(SDL_SCANCODE_F5)) {
+        compact();
+    }
+    if (ctx.check_key_invalidate(SDL_SCANCODE_F9)) {
+        recover();
+    }
+    if (ctx.check_key(SDL_SCANCODE_LCTRL) && ctx.check_key_invalidate(SDL_SCANCODE_Z)) {
+        undo();
+    }
+    if (ctx.check_key(SDL_SCANCODE_LCTRL) && ctx.check_key_invalidate(SDL_SCANCODE_Y)) {
+        redo();
+    }
+    // cycle through the overlays, then none
+    if (ctx.check_key_invalidate(SDL_SCANCODE_O)) {
+        overlay_shown = (overlay_shown + 2) % (OVERLAY_COUNT + 1) - 1;
+    }
     printf("%d, %d\n", screen_offset.x, screen_offset.y);
 
-    ctx.draw_rect(Red, SDL_Rect{world_component->x, world_component->y, world_component->w, world_component->h});
+    ctx.draw_rect(Red, *ctx.components.rect(world_component));
 }
 
 WorldData *world;
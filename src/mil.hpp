@@ -0,0 +1,251 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flow.hpp"
+#include "history.hpp"
+#include "journal.hpp"
+#include "modules.hpp"
+#include "overlay.hpp"
+#include "path.hpp"
+#include "path_service.hpp"
+#include "road.hpp"
+#include "save.hpp"
+#include "sim.hpp"
+#include "snapshot.hpp"
+#include "traffic.hpp"
+#include "utility.hpp"
+
+// FIRST ITEM is DEFAULT
+enum TileName {
+    TILE_GRASS,
+    TILE_BUILDING_TENT,
+    TILE_HIGHLIGHT_MOUSE,
+    TILE_ROAD_DIRT_STRAIGHT_NS,
+    TILE_ROAD_DIRT_CORNER_NE,
+    TILE_ROAD_DIRT_CORNER_SE,
+    TILE_ROAD_DIRT_CORNER_SW,
+    TILE_ROAD_DIRT_CORNER_NW,
+    TILE_TEST_11,
+    TILE_TEST_22,
+    TILE_TEST_31,
+    TILE_TEST_224,
+    TILE_COUNT
+};
+
+enum TileFlag {
+    TILE_FLAG_GROUND = 1 << 0, // flat on the ground, drawn beneath everything else
+    TILE_FLAG_ROAD   = 1 << 1, // part of the road network
+    TILE_FLAG_WALK   = 1 << 2, // agents can walk over it
+    TILE_FLAG_POWER  = 1 << 3, // supplies power to whatever it connects to
+    TILE_FLAG_WATER  = 1 << 4, // supplies water to whatever it connects to
+};
+
+// draw list layers, in the order they are drawn
+enum DrawLayer {
+    LAYER_GROUND,
+    LAYER_OBJECTS,
+    LAYER_OVERLAY,
+    LAYER_COUNT
+};
+
+constexpr int MAGIC_OFFSCREEN_MAX = 5;
+constexpr int DEPTH_STEPS = 8; // draw depth resolution within one tile
+constexpr int CHUNK_SIZE = 32; // tiles per side of a chunk
+constexpr int BULK_PARALLEL_MIN = 1 << 16; // tiles before bulk edits are split across workers
+constexpr int LOAD_CHUNKS_PER_FRAME = 4; // chunks of a loaded save read in each update that are needed, the rest are read in the background
+constexpr float PREFETCH_AHEAD = 0.5f; // seconds of camera motion looked ahead for chunks coming into view
+constexpr int PREFETCH_PER_FRAME = 4; // chunks coming into view handed out in each update
+constexpr const char *SAVE_PATH = "simmil.sav";
+constexpr size_t JOURNAL_COMPACT_BYTES = 1 << 20; // journal size that makes a new snapshot
+constexpr int OVERLAY_RADIUS = 4; // tiles each blur pass spreads influence
+constexpr int OVERLAY_LEVELS = 16; // shades an overlay is drawn in
+constexpr int OVERLAY_BAND = 3; // pixels tall of each strip an overlay diamond is drawn with
+
+struct TileDefinition {
+    TileName name;
+    pse::ivec3 worldsize; // number of tiles x/y/z the tile takes up
+    int id; // read-only, auto managed
+    uint64_t opaque; // read-only, opaque coverage of the image, see pse/occlusion.hpp
+    unsigned flags; // TileFlag
+    int influence[OVERLAY_SPREAD]; // on every tile it takes up, by OverlayKind
+    // Tile{TILE_GRASS, ivec2{1, 1}, ctx.load_image("assets/tile_grass.png")};
+    TileDefinition();
+    TileDefinition(TileName name, pse::ivec3 size, int id, uint64_t opaque, unsigned flags);
+};
+
+struct TileManager {
+    TileDefinition *definition;
+    /* Multi-tile objects are drawn once, by the drawer. Draw order
+       comes from the depth of the drawer's object, see tile_draw. */
+    TileManager *drawer; // the one who can draw, closest to the top of the screen
+    pse::ivec2 world_coords;
+    TileManager();
+};
+
+struct TilePlacement {
+    TileName name;
+    int wx;
+    int wy;
+};
+
+// codes of a chunk read in from the save on a worker, before it's needed
+struct ChunkPrefetch {
+    std::shared_ptr<const SaveFile> file;
+    std::shared_ptr<ChunkCodes> codes; // null if the table already has them
+    bool ok = false;
+    std::atomic<bool> done{false};
+};
+
+// agent components, in tiles
+struct Position {
+    float x;
+    float y;
+};
+
+struct Velocity {
+    float x; // per second
+    float y;
+};
+
+struct Sprite {
+    int id;
+    float w;
+    float h;
+};
+
+struct WorldData {
+    pse::context& ctx;
+    TileManager *world; // array of tile managers
+
+    pse::ivec2 screen_tilesize; // tile width and height in pixels
+    pse::ivec2 world_origin;
+    pse::ivec2 screen_offset;
+    int world_height; // grids of the world tall
+    int world_width; // grids of the world wide
+    int world_hdiag;
+    int world_vdiag;
+    int chunks_wide; // CHUNK_SIZE x CHUNK_SIZE groups of tiles, edge chunks may be partial
+    int chunks_tall;
+    pse::component menu_component; // in ctx.components
+    pse::component world_component; // in ctx.components
+    RoadGraph roads;
+    PathFinder paths;
+    PathService path_queries; // answered at the start of each update
+    FlowFields flows; // for crowds heading to the same place
+    pse::registry agents; // everything that moves around the world
+    pse::spatial_hash agent_cells; // agent positions by entity index, for finding what's nearby
+    Traffic traffic; // vehicles on the roads
+    CitySim sim; // land value, growth and fire
+    UtilityNetwork utilities; // power and water run through everything built
+    pse::sumgrid tile_counts[TILE_COUNT]; // objects of each kind, on the tile they are drawn from
+    Overlay overlays[OVERLAY_SPREAD]; // what the tiles spread around them, by OverlayKind
+    int overlay_shown = -1; // OverlayKind drawn over the world, -1 for none
+private:
+    TileDefinition definitions[TILE_COUNT];
+    TileDefinition *defaultdef = definitions;
+    int tile_reach = 1; // most tiles any sprite reaches from its drawer, for culling
+    pse::bitgrid occupied; // one bit per tile, set when it is not the default tile
+    pse::drawlist draws{LAYER_COUNT}; // this frame's sprites
+    pse::occlusion occluder;
+    std::shared_ptr<const SaveFile> loaded{}; // save that chunks are still being read in from
+    std::shared_ptr<ChunkTable> chunk_table{}; // codes of every chunk, shared with snapshots until either writes
+    std::vector<char> chunk_requested{};
+    std::vector<int> chunk_requests{}; // chunks asked for that aren't placed yet, read in before any others
+    std::vector<int> placeholders{}; // chunks on screen not placed yet
+    pse::vec2<float> camera_velocity{0.0f, 0.0f}; // screen_offset, pixels per second
+    float zoom_velocity = 0.0f; // screen_tilesize.x, pixels per second
+    pse::ivec2 camera_last{0, 0};
+    int zoom_last = 0;
+    std::vector<std::shared_ptr<ChunkPrefetch>> chunk_prefetch{}; // chunks handed out, until they're placed
+    std::vector<int> prefetch_queue{}; // placed once their codes are ready, after what's on screen
+    std::vector<char> chunk_pending{}; // chunk is still in loaded
+    int pending_chunks = 0;
+    int load_cursor = 0; // where load_idle looks for pending chunks next
+    std::vector<int> idle_jobs{}; // in ctx.background
+    bool decoding = false;
+    bool forked = false; // a what-if copy, see fork
+    std::shared_ptr<SaveJob> save_job{};
+    Journal journal{}; // edits since the snapshot of this generation
+    uint64_t generation = 0;
+    uint64_t journal_first = 0; // oldest journal that may still be on disk
+    bool compacting = false; // the save going is a new snapshot
+    int journal_mute = 0; // edits aren't recorded while it's above 0
+    History history{};
+    int history_depth = 0; // history_begin not yet ended
+    bool history_replaying = false;
+    uint32_t history_step = 1; // step being recorded
+    std::vector<uint32_t> history_marks{}; // step that last touched each chunk
+    std::vector<std::pair<int, std::shared_ptr<ChunkCodes>>> history_before{}; // chunks the step touched, as they were
+
+public:
+    WorldData(pse::context& ctx, int height, int width);
+    ~WorldData();
+    void setup();
+    bool fork(const WorldData& live, const WorldSnapshot& from); // instead of setup, false if it's a world of another size
+    void step(float dt); // without drawing or input, update does this too
+    void update();
+    pse::ivec2 world_to_screen(int wx, int wy);
+    pse::ivec2 world_point_to_screen(float wx, float wy);
+    void tile_load(TileName name, int gridx, int gridy, int gridz, const char *path, unsigned flags = 0);
+    void tile_influence(TileName name, OverlayKind kind, int strength);
+    bool tile_place(TileName name, int wx, int wy);
+    void tile_remove(int wx, int wy);
+    bool tile_fill(TileName name, int wx, int wy, int w, int h);
+    int tile_place_list(const std::vector<TilePlacement>& list);
+    void tile_clear(int wx, int wy, int w, int h);
+    void history_begin(); // edits until the matching history_end are undone as one, like a stroke
+    void history_end();
+    bool undo(); // false if there's nothing to undo or a step is still open
+    bool redo();
+    bool region_free(int wx, int wy, int w, int h);
+    bool find_free_spot(TileName name, int wx, int wy, int radius, pse::ivec2& out);
+    int64_t count_in(TileName name, int wx, int wy, int w, int h) const;
+    void tile_draw(int wx, int wy);
+    void sprite_draw(int id, float wx, float wy, float w, float h);
+    void tile_draw_flush();
+    pse::entity agent_spawn(TileName look, float wx, float wy, float vx, float vy);
+    void agent_remove(pse::entity e);
+    void agents_update(float dt);
+    void agents_draw();
+    void traffic_draw();
+    void overlay_draw();
+    bool world_save(const char *path, uint64_t generation = 0); // writes in the background, false if the last save is still going
+    bool world_load(const char *path); // false if it isn't a save of a world this size
+    bool saving() const;
+    WorldSnapshot snapshot() const; // O(1), stays as it is while the world goes on
+    bool world_restore(const WorldSnapshot& from); // false if it's a world of another size
+    bool chunk_request(int chunk); // false if it isn't placed yet, it's asked for and never waited on
+    bool recover(); // last snapshot with every journal on top of it replayed, false while a save is going or in a fork
+    void compact(); // new snapshot and a journal on top of it, the old journals go once it's written, never in a fork
+private:
+    void visible_bounds(int reach, int& dmin, int& dmax, int& emin, int& emax);
+    void view_bounds(pse::ivec2 offset, pse::ivec2 tilesize, int reach, int& dmin, int& dmax, int& emin, int& emax);
+    bool sprite_visible(float wx, float wy, float w, float h);
+    void influence_apply(TileDefinition *def, int wx, int wy, int w, int h, int sign);
+    void region_write(TileDefinition *def, int wx, int wy, int w, int h);
+    void demo_place();
+    void chunk_decode(int chunk);
+    void chunk_table_own();
+    ChunkCodes& chunk_codes_write(int chunk); // only after chunk_table_own
+    void code_set(int wx, int wy, uint8_t code);
+    void chunks_ensure(int wx, int wy, int w, int h);
+    void load_step();
+    bool load_idle();
+    void loaded_drop();
+    bool overlay_idle();
+    void prefetch_step();
+    void placeholder_draw();
+    void journal_record(JournalOp op, int name, int wx, int wy, int w, int h);
+    void journal_step();
+    std::string journal_path(uint64_t g) const;
+    void history_touch(int chunk);
+    void history_commit(); // ends the step of an edit, unless it's part of a bigger one
+    void history_apply(const HistoryStep& step);
+    void history_edits(const std::vector<std::vector<TilePlacement>>& lists, bool place); // by chunk
+    bool history_grid_edit(const std::vector<TilePlacement>& list, bool place); // false if it isn't a grid, and nothing's done
+};
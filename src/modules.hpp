@@ -5,6 +5,10 @@
 void demo_setup(pse::context& ctx);
 void demo_update(pse::context& ctx);
 
+void bench_setup(pse::context& ctx);
+void bench_update(pse::context& ctx);
+void bench_cleanup(pse::context& ctx);
+
 void simmil_setup(pse::context& ctx);
 void simmil_update(pse::context& ctx);
 void simmil_cleanup(pse::context& ctx);
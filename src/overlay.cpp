@@ -0,0 +1,204 @@
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OVERLAY_SSE2
+#endif
+
+#include "overlay.hpp"
+
+using namespace pse;
+
+/**
+ * Box blur of every row, out of range is 0
+ */
+static void blur_across(const float *in, float *out, int w, int h, int stride, int r)
+{
+    const float scale = 1.0f / (2 * r + 1);
+    for (int y = 0; y < h; y++) {
+        const float *row = in + y * stride;
+        float *dst = out + y * stride;
+        float sum = 0.0f;
+        for (int x = 0; x < std::min(r, w); x++) {
+            sum += row[x];
+        }
+        for (int x = 0; x < w; x++) {
+            if (x + r < w) {
+                sum += row[x + r];
+            }
+            dst[x] = sum * scale;
+            if (x - r >= 0) {
+                sum -= row[x - r];
+            }
+        }
+    }
+}
+
+/**
+ * Box blur of every column, out of range is 0. The sums
+ * run down 4 columns at once, stride is a multiple of 4.
+ */
+static void blur_down(const float *in, float *out, int h, int stride, int r)
+{
+    const float scale = 1.0f / (2 * r + 1);
+    int x = 0;
+#ifdef OVERLAY_SSE2
+    const __m128 s = _mm_set1_ps(scale);
+    for (; x + 4 <= stride; x += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int y = 0; y < std::min(r, h); y++) {
+            sum = _mm_add_ps(sum, _mm_loadu_ps(in + y * stride + x));
+        }
+        for (int y = 0; y < h; y++) {
+            if (y + r < h) {
+                sum = _mm_add_ps(sum, _mm_loadu_ps(in + (y + r) * stride + x));
+            }
+            _mm_storeu_ps(out + y * stride + x, _mm_mul_ps(sum, s));
+            if (y - r >= 0) {
+                sum = _mm_sub_ps(sum, _mm_loadu_ps(in + (y - r) * stride + x));
+            }
+        }
+    }
+#endif
+    for (; x < stride; x++) {
+        float sum = 0.0f;
+        for (int y = 0; y < std::min(r, h); y++) {
+            sum += in[y * stride + x];
+        }
+        for (int y = 0; y < h; y++) {
+            if (y + r < h) {
+                sum += in[(y + r) * stride + x];
+            }
+            out[y * stride + x] = sum * scale;
+            if (y - r >= 0) {
+                sum -= in[(y - r) * stride + x];
+            }
+        }
+    }
+}
+
+void Overlay::resize(int width, int height, int chunk_size, int radius)
+{
+    this->width = width;
+    this->height = height;
+    this->chunk_size = chunk_size;
+    this->radius = radius;
+    chunks_wide = (width + chunk_size - 1) / chunk_size;
+    chunks_tall = (height + chunk_size - 1) / chunk_size;
+    sources.assign(width * height, 0);
+    field.assign(width * height, 0);
+    dirty.assign(chunks_wide * chunks_tall, 0);
+    dirty_list.clear();
+
+    // the middle of one blurred tile, across and down
+    const int n = 2 * OVERLAY_PASSES * radius + 1;
+    std::vector<float> a(n, 0.0f);
+    std::vector<float> b(n, 0.0f);
+    a[n / 2] = 1.0f;
+    for (int p = 0; p < OVERLAY_PASSES; p++) {
+        blur_across(a.data(), b.data(), n, 1, n, radius);
+        a.swap(b);
+    }
+    gain = 1.0f / (a[n / 2] * a[n / 2]);
+}
+
+void Overlay::add(int wx, int wy, int w, int h, int strength)
+{
+    if (strength == 0) {
+        return;
+    }
+    for (int y = wy; y < wy + h; y++) {
+        for (int x = wx; x < wx + w; x++) {
+            sources[y * width + x] += strength;
+        }
+    }
+
+    const int reach = OVERLAY_PASSES * radius;
+    const int cx0 = std::max(wx - reach, 0) / chunk_size;
+    const int cy0 = std::max(wy - reach, 0) / chunk_size;
+    const int cx1 = std::min(wx + w - 1 + reach, width - 1) / chunk_size;
+    const int cy1 = std::min(wy + h - 1 + reach, height - 1) / chunk_size;
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+            int c = cy * chunks_wide + cx;
+            if (!dirty[c]) {
+                dirty[c] = 1;
+                dirty_list.push_back(c);
+            }
+        }
+    }
+}
+
+bool Overlay::stale() const
+{
+    return !dirty_list.empty();
+}
+
+int Overlay::get(int wx, int wy) const
+{
+    return field[wy * width + wx];
+}
+
+/**
+ * Blur the sources around a chunk and keep the middle. Every pass is
+ * wrong within radius of the edge of what was read in, so reading in
+ * OVERLAY_PASSES * radius past the chunk leaves the chunk itself right.
+ */
+void Overlay::chunk_blur(int chunk)
+{
+    const int reach = OVERLAY_PASSES * radius;
+    const int x0 = (chunk % chunks_wide) * chunk_size;
+    const int y0 = (chunk / chunks_wide) * chunk_size;
+    const int x1 = std::min(x0 + chunk_size, width);
+    const int y1 = std::min(y0 + chunk_size, height);
+    const int ox = x0 - reach;
+    const int oy = y0 - reach;
+    const int w = (x1 - x0) + 2 * reach;
+    const int h = (y1 - y0) + 2 * reach;
+    const int stride = (w + 3) & ~3;
+
+    frame_vector<float> a(stride * h, 0.0f);
+    frame_vector<float> b(stride * h, 0.0f);
+    for (int y = std::max(oy, 0); y < std::min(oy + h, height); y++) {
+        for (int x = std::max(ox, 0); x < std::min(ox + w, width); x++) {
+            a[(y - oy) * stride + (x - ox)] = (float)sources[y * width + x];
+        }
+    }
+
+    for (int p = 0; p < OVERLAY_PASSES; p++) {
+        blur_across(a.data(), b.data(), w, h, stride, radius);
+        blur_down(b.data(), a.data(), h, stride, radius);
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            float v = a[(y - oy) * stride + (x - ox)] * gain;
+            field[y * width + x] = (uint8_t)std::min(std::max(v + 0.5f, 0.0f), 255.0f);
+        }
+    }
+}
+
+void Overlay::refresh_one()
+{
+    if (dirty_list.empty()) {
+        return;
+    }
+    int c = dirty_list.back();
+    dirty_list.pop_back();
+    chunk_blur(c);
+    dirty[c] = 0;
+}
+
+void Overlay::refresh(pool& workers)
+{
+    if (dirty_list.empty()) {
+        return;
+    }
+    workers.parallel_for((int)dirty_list.size(), [this](int i) {
+        chunk_blur(dirty_list[i]);
+    });
+    for (int c : dirty_list) {
+        dirty[c] = 0;
+    }
+    dirty_list.clear();
+}
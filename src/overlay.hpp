@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pse/pse.hpp"
+
+enum OverlayKind {
+    OVERLAY_POLLUTION,
+    OVERLAY_NOISE,
+    OVERLAY_COVERAGE,
+    OVERLAY_LAND_VALUE, // straight from the sim, not spread out here
+    OVERLAY_COUNT,
+    OVERLAY_SPREAD = OVERLAY_LAND_VALUE, // kinds before this are Overlay fields
+};
+
+constexpr int OVERLAY_PASSES = 3; // box blurs, three are close to a gaussian
+
+/**
+ * A field over the tiles that sources spread out over, 0..255.
+ * Sources are blurred with box blurs across then down, the blur down
+ * handles 4 columns at a time. The blur is separable, so only the chunks
+ * within reach of a source that changed are recomputed, each from the
+ * sources around it, in parallel.
+ *
+ * A lone tile of strength s reads s on itself and fades to nothing
+ * OVERLAY_PASSES * radius tiles away, nearby sources add up.
+ */
+class Overlay {
+public:
+    void resize(int width, int height, int chunk_size, int radius); // removes every source
+    void add(int wx, int wy, int w, int h, int strength); // on every tile of the rect, negative takes it away
+    void refresh(pse::pool& workers); // recompute what changed
+    void refresh_one(); // recompute one chunk of what changed, on this thread
+    bool stale() const;
+    int get(int wx, int wy) const;
+    int width = 0;
+    int height = 0;
+    int chunk_size = 0;
+    int chunks_wide = 0;
+    int chunks_tall = 0;
+    int radius = 0;
+private:
+    float gain = 1.0f; // makes the middle of a lone tile read its strength
+    std::vector<int> sources{};
+    std::vector<uint8_t> field{};
+    std::vector<char> dirty{};
+    std::vector<int> dirty_list{};
+
+    void chunk_blur(int chunk);
+};
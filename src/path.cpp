@@ -0,0 +1,631 @@
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <queue>
+
+#include "path.hpp"
+
+using namespace pse;
+
+static const int dir_x[4] = { 1, 0, -1, 0 };
+static const int dir_y[4] = { 0, 1, 0, -1 };
+
+// entrances wider than this get one at either end instead of the middle
+constexpr int WIDE_ENTRANCE = 6;
+
+// routes each search remembers
+constexpr size_t ROUTE_CAPACITY = 1024;
+
+void PathFinder::resize(int width, int height, int chunk_size)
+{
+    this->width = width;
+    this->height = height;
+    this->chunk_size = chunk_size;
+    chunks_wide = (width + chunk_size - 1) / chunk_size;
+    chunks_tall = (height + chunk_size - 1) / chunk_size;
+    // a border side has at most one entrance every other tile, 4 sides
+    node_stride = 2 * chunk_size + 4;
+
+    // everything starts blocked until the world says otherwise
+    chunks.resize(chunks_wide * chunks_tall);
+    for (std::shared_ptr<PathChunk>& c : chunks) {
+        c = std::make_shared<PathChunk>();
+        c->blocked.resize(chunk_size, chunk_size);
+        c->blocked.fill_rect(0, 0, chunk_size, chunk_size, true);
+    }
+
+    node_of_cell.clear();
+    border_nodes.assign(chunks_wide * chunks_tall * 2, std::vector<int>{});
+    dirty.assign(chunks_wide * chunks_tall, 0);
+    dirty_list.clear();
+    edits++;
+    // past every version handed out before, so nothing from the old world looks current
+    versions.assign(chunks_wide * chunks_tall, edits);
+    search = PathSearch{};
+}
+
+bool PathFinder::walkable(int wx, int wy) const
+{
+    if (wx < 0 || wx >= width || wy < 0 || wy >= height) {
+        return false;
+    }
+    const PathChunk& c = *chunks[(wy / chunk_size) * chunks_wide + wx / chunk_size];
+    return !c.blocked.get(wx % chunk_size, wy % chunk_size);
+}
+
+const bitgrid& PathFinder::chunk_walls(int chunk) const
+{
+    return chunks[chunk]->blocked;
+}
+
+int PathFinder::chunk_of(int cell) const
+{
+    return (cell / width / chunk_size) * chunks_wide + (cell % width) / chunk_size;
+}
+
+unsigned PathFinder::chunk_version(int chunk) const
+{
+    return versions[chunk];
+}
+
+unsigned PathFinder::revision() const
+{
+    return edits;
+}
+
+/**
+ * Only what searches read, the chunks are
+ * shared until this writes to them again
+ */
+std::shared_ptr<const PathFinder> PathFinder::snapshot()
+{
+    rebuild();
+    auto copy = std::make_shared<PathFinder>();
+    copy->width = width;
+    copy->height = height;
+    copy->chunk_size = chunk_size;
+    copy->chunks_wide = chunks_wide;
+    copy->chunks_tall = chunks_tall;
+    copy->chunks = chunks;
+    copy->node_stride = node_stride;
+    copy->versions = versions;
+    copy->edits = edits;
+    return copy;
+}
+
+const PathNode& PathFinder::node(int id) const
+{
+    return chunks[id / node_stride]->nodes[id % node_stride];
+}
+
+PathChunk& PathFinder::chunk_write(int chunk)
+{
+    std::shared_ptr<PathChunk>& c = chunks[chunk];
+    if (c.use_count() > 1) {
+        c = std::make_shared<PathChunk>(*c);
+    }
+    return *c;
+}
+
+PathNode& PathFinder::node_write(int id)
+{
+    return chunk_write(id / node_stride).nodes[id % node_stride];
+}
+
+void PathFinder::set_walkable(int wx, int wy, int w, int h, bool walkable)
+{
+    const int cx0 = wx / chunk_size;
+    const int cy0 = wy / chunk_size;
+    const int cx1 = (wx + w - 1) / chunk_size;
+    const int cy1 = (wy + h - 1) / chunk_size;
+
+    // the part of the rect inside of each chunk, in its own tiles
+    auto each = [&](auto fn) {
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                int x0 = std::max(wx, cx * chunk_size);
+                int y0 = std::max(wy, cy * chunk_size);
+                int x1 = std::min(wx + w, (cx + 1) * chunk_size);
+                int y1 = std::min(wy + h, (cy + 1) * chunk_size);
+                if (!fn(cy * chunks_wide + cx, x0 - cx * chunk_size, y0 - cy * chunk_size, x1 - x0, y1 - y0)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    if (walkable && each([this](int c, int x, int y, int cw, int ch) { return !chunks[c]->blocked.any_rect(x, y, cw, ch); })) {
+        return;
+    }
+    edits++;
+
+    each([this, walkable](int c, int x, int y, int cw, int ch) {
+        chunk_write(c).blocked.fill_rect(x, y, cw, ch, !walkable);
+        versions[c]++;
+        if (!dirty[c]) {
+            dirty[c] = 1;
+            dirty_list.push_back(c);
+        }
+        return true;
+    });
+}
+
+int PathFinder::node_new(int cell)
+{
+    auto it = node_of_cell.find(cell);
+    if (it != node_of_cell.end()) {
+        node_write(it->second).borders++;
+        return it->second;
+    }
+
+    const int chunk = chunk_of(cell);
+    std::vector<PathNode>& in_chunk = chunk_write(chunk).nodes;
+    size_t i = 0;
+    while (i < in_chunk.size() && in_chunk[i].alive) {
+        i++;
+    }
+    if (i == in_chunk.size()) {
+        in_chunk.emplace_back();
+    }
+    assert((int)i < node_stride);
+
+    PathNode& n = in_chunk[i];
+    n.cell = cell;
+    n.chunk = chunk;
+    n.borders = 1;
+    n.intra.clear();
+    n.inter.clear();
+    n.alive = true;
+    int id = chunk * node_stride + (int)i;
+    node_of_cell[cell] = id;
+    return id;
+}
+
+void PathFinder::node_release(int node)
+{
+    PathNode& n = node_write(node);
+    if (--n.borders > 0) {
+        return;
+    }
+    node_of_cell.erase(n.cell);
+    n.alive = false;
+}
+
+void PathFinder::border_clear(int border)
+{
+    std::vector<int>& pairs = border_nodes[border];
+    for (size_t i = 0; i + 1 < pairs.size(); i += 2) {
+        int a = pairs[i];
+        int b = pairs[i + 1];
+        auto unlink = [&](int from, int to) {
+            std::vector<PathLink>& links = node_write(from).inter;
+            for (size_t k = 0; k < links.size(); k++) {
+                if (links[k].to == to) {
+                    links.erase(links.begin() + k);
+                    return;
+                }
+            }
+        };
+        unlink(a, b);
+        unlink(b, a);
+        node_release(a);
+        node_release(b);
+    }
+    pairs.clear();
+}
+
+/**
+ * Find the entrances along one border, every run of tiles walkable on
+ * both sides of it becomes one entrance, or two when it is wide
+ */
+void PathFinder::border_build(int border)
+{
+    const int chunk = border / 2;
+    const bool east = (border % 2) == 0;
+    const int cx = chunk % chunks_wide;
+    const int cy = chunk / chunks_wide;
+
+    if ((east && cx + 1 >= chunks_wide) || (!east && cy + 1 >= chunks_tall)) {
+        return;
+    }
+
+    // walk along the border, a is inside of the chunk and b is across
+    const int length = east ? std::min(chunk_size, height - cy * chunk_size)
+                            : std::min(chunk_size, width - cx * chunk_size);
+    auto cell_a = [&](int i) {
+        return east ? (cy * chunk_size + i) * width + (cx + 1) * chunk_size - 1
+                    : ((cy + 1) * chunk_size - 1) * width + cx * chunk_size + i;
+    };
+    auto cell_b = [&](int i) {
+        return east ? cell_a(i) + 1 : cell_a(i) + width;
+    };
+    auto open = [&](int i) {
+        int a = cell_a(i);
+        int b = cell_b(i);
+        return walkable(a % width, a / width) && walkable(b % width, b / width);
+    };
+    auto transition = [&](int i) {
+        int a = node_new(cell_a(i));
+        int b = node_new(cell_b(i));
+        node_write(a).inter.push_back(PathLink{ b, 1 });
+        node_write(b).inter.push_back(PathLink{ a, 1 });
+        border_nodes[border].push_back(a);
+        border_nodes[border].push_back(b);
+    };
+
+    int i = 0;
+    while (i < length) {
+        if (!open(i)) {
+            i++;
+            continue;
+        }
+        int start = i;
+        while (i < length && open(i)) {
+            i++;
+        }
+        int end = i - 1;
+        if (end - start + 1 >= WIDE_ENTRANCE) {
+            transition(start);
+            transition(end);
+        }
+        else {
+            transition((start + end) / 2);
+        }
+    }
+}
+
+/**
+ * Breadth first search from a tile, without leaving its chunk
+ */
+void PathFinder::local_search(PathSearch& s, int chunk, int from) const
+{
+    const int x0 = (chunk % chunks_wide) * chunk_size;
+    const int y0 = (chunk / chunks_wide) * chunk_size;
+    const int x1 = std::min(x0 + chunk_size, width);
+    const int y1 = std::min(y0 + chunk_size, height);
+    const bitgrid& blocked = chunks[chunk]->blocked;
+
+    s.local_dist.assign(chunk_size * chunk_size, -1);
+    s.local_from.resize(chunk_size * chunk_size);
+    s.local_queue.resize(chunk_size * chunk_size);
+
+    int head = 0;
+    int tail = 0;
+    int start = (from / width - y0) * chunk_size + (from % width - x0);
+    s.local_dist[start] = 0;
+    s.local_from[start] = -1;
+    s.local_queue[tail++] = start;
+
+    while (head < tail) {
+        int l = s.local_queue[head++];
+        int lx = l % chunk_size;
+        int ly = l / chunk_size;
+        for (int d = 0; d < 4; d++) {
+            int nx = lx + dir_x[d];
+            int ny = ly + dir_y[d];
+            if (nx < 0 || ny < 0 || x0 + nx >= x1 || y0 + ny >= y1) {
+                continue;
+            }
+            int n = ny * chunk_size + nx;
+            if (s.local_dist[n] != -1 || blocked.get(nx, ny)) {
+                continue;
+            }
+            s.local_dist[n] = s.local_dist[l] + 1;
+            s.local_from[n] = l;
+            s.local_queue[tail++] = n;
+        }
+    }
+}
+
+bool PathFinder::local_path(PathSearch& s, int chunk, int from, int to, std::vector<int>& cells) const
+{
+    const int x0 = (chunk % chunks_wide) * chunk_size;
+    const int y0 = (chunk / chunks_wide) * chunk_size;
+
+    local_search(s, chunk, from);
+    int l = (to / width - y0) * chunk_size + (to % width - x0);
+    if (s.local_dist[l] == -1) {
+        return false;
+    }
+
+    size_t first = cells.size();
+    for (; s.local_from[l] != -1; l = s.local_from[l]) {
+        cells.push_back((y0 + l / chunk_size) * width + x0 + l % chunk_size);
+    }
+    std::reverse(cells.begin() + first, cells.end());
+    return true;
+}
+
+/**
+ * Cost between every pair of entrances in a chunk
+ */
+void PathFinder::chunk_link(int chunk)
+{
+    const int x0 = (chunk % chunks_wide) * chunk_size;
+    const int y0 = (chunk / chunks_wide) * chunk_size;
+    std::vector<PathNode>& in_chunk = chunk_write(chunk).nodes;
+
+    for (PathNode& n : in_chunk) {
+        n.intra.clear();
+    }
+    for (PathNode& n : in_chunk) {
+        if (!n.alive) {
+            continue;
+        }
+        local_search(search, chunk, n.cell);
+        for (size_t m = 0; m < in_chunk.size(); m++) {
+            if (!in_chunk[m].alive) {
+                continue;
+            }
+            int cell = in_chunk[m].cell;
+            int dist = search.local_dist[(cell / width - y0) * chunk_size + (cell % width - x0)];
+            if (&in_chunk[m] != &n && dist > 0) {
+                n.intra.push_back(PathLink{ chunk * node_stride + (int)m, dist });
+            }
+        }
+    }
+}
+
+void PathFinder::rebuild()
+{
+    if (dirty_list.empty()) {
+        return;
+    }
+
+    std::vector<int> borders;
+    std::vector<int> relink;
+    for (int c : dirty_list) {
+        int cx = c % chunks_wide;
+        int cy = c / chunks_wide;
+        borders.push_back(c * 2);
+        borders.push_back(c * 2 + 1);
+        relink.push_back(c);
+        if (cx > 0) {
+            borders.push_back((c - 1) * 2);
+            relink.push_back(c - 1);
+        }
+        if (cy > 0) {
+            borders.push_back((c - chunks_wide) * 2 + 1);
+            relink.push_back(c - chunks_wide);
+        }
+        if (cx + 1 < chunks_wide) relink.push_back(c + 1);
+        if (cy + 1 < chunks_tall) relink.push_back(c + chunks_wide);
+        dirty[c] = 0;
+    }
+    dirty_list.clear();
+
+    std::sort(borders.begin(), borders.end());
+    borders.erase(std::unique(borders.begin(), borders.end()), borders.end());
+    std::sort(relink.begin(), relink.end());
+    relink.erase(std::unique(relink.begin(), relink.end()), relink.end());
+
+    for (int b : borders) {
+        border_clear(b);
+    }
+    for (int b : borders) {
+        border_build(b);
+    }
+    for (int c : relink) {
+        chunk_link(c);
+    }
+}
+
+/**
+ * A* over the entrances, from the entrances of the start chunk
+ * the start can reach to the ones of the goal chunk that reach the goal
+ */
+bool PathFinder::abstract_search(PathSearch& s, int from, int to, std::vector<int>& waypoints) const
+{
+    const int from_chunk = chunk_of(from);
+    const int to_chunk = chunk_of(to);
+    const int tx = to % width;
+    const int ty = to / width;
+
+    const size_t ids = chunks.size() * node_stride;
+    if (s.search_g.size() < ids) {
+        s.search_g.resize(ids);
+        s.search_parent.resize(ids);
+        s.search_stamp.resize(ids, 0);
+        s.goal_cost.resize(ids);
+        s.goal_stamp.resize(ids, 0);
+    }
+    s.stamp++;
+
+    auto local_cost = [&](int chunk, int id) {
+        int cell = node(id).cell;
+        int x0 = (chunk % chunks_wide) * chunk_size;
+        int y0 = (chunk / chunks_wide) * chunk_size;
+        return s.local_dist[(cell / width - y0) * chunk_size + (cell % width - x0)];
+    };
+    auto heuristic = [&](int id) {
+        int cell = node(id).cell;
+        return std::abs(cell % width - tx) + std::abs(cell / width - ty);
+    };
+
+    const std::vector<PathNode>& to_nodes = chunks[to_chunk]->nodes;
+    local_search(s, to_chunk, to);
+    for (int i = 0; i < (int)to_nodes.size(); i++) {
+        if (!to_nodes[i].alive) {
+            continue;
+        }
+        int n = to_chunk * node_stride + i;
+        int cost = local_cost(to_chunk, n);
+        if (cost >= 0) {
+            s.goal_cost[n] = cost;
+            s.goal_stamp[n] = s.stamp;
+        }
+    }
+
+    typedef std::pair<int, int> entry; // f, node
+    std::priority_queue<entry, std::vector<entry>, std::greater<entry>> open;
+
+    const std::vector<PathNode>& from_nodes = chunks[from_chunk]->nodes;
+    local_search(s, from_chunk, from);
+    for (int i = 0; i < (int)from_nodes.size(); i++) {
+        if (!from_nodes[i].alive) {
+            continue;
+        }
+        int n = from_chunk * node_stride + i;
+        int cost = local_cost(from_chunk, n);
+        if (cost >= 0) {
+            s.search_g[n] = cost;
+            s.search_parent[n] = -1;
+            s.search_stamp[n] = s.stamp;
+            open.push(entry{ cost + heuristic(n), n });
+        }
+    }
+
+    int best = INT_MAX;
+    int best_last = -1;
+    while (!open.empty()) {
+        entry top = open.top();
+        open.pop();
+        if (top.first >= best) {
+            break;
+        }
+        int n = top.second;
+        if (top.first > s.search_g[n] + heuristic(n)) {
+            continue; // stale
+        }
+        if (s.goal_stamp[n] == s.stamp && s.search_g[n] + s.goal_cost[n] < best) {
+            best = s.search_g[n] + s.goal_cost[n];
+            best_last = n;
+        }
+
+        auto relax = [&](const std::vector<PathLink>& links) {
+            for (const PathLink& l : links) {
+                int g = s.search_g[n] + l.cost;
+                if (s.search_stamp[l.to] != s.stamp || g < s.search_g[l.to]) {
+                    s.search_g[l.to] = g;
+                    s.search_parent[l.to] = n;
+                    s.search_stamp[l.to] = s.stamp;
+                    open.push(entry{ g + heuristic(l.to), l.to });
+                }
+            }
+        };
+        relax(node(n).intra);
+        relax(node(n).inter);
+    }
+
+    if (best_last == -1) {
+        return false;
+    }
+
+    waypoints.clear();
+    for (int n = best_last; n != -1; n = s.search_parent[n]) {
+        waypoints.push_back(n);
+    }
+    std::reverse(waypoints.begin(), waypoints.end());
+    return true;
+}
+
+bool PathFinder::route_valid(const PathSearch::Route& r) const
+{
+    for (auto& c : r.chunks) {
+        if (versions[c.first] != c.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PathFinder::find(ivec2 from, ivec2 to, std::vector<ivec2>& path)
+{
+    rebuild();
+    return find(from, to, path, search);
+}
+
+bool PathFinder::find(ivec2 from, ivec2 to, std::vector<ivec2>& path, PathSearch& s) const
+{
+    path.clear();
+    if (!walkable(from.x, from.y) || !walkable(to.x, to.y)) {
+        return false;
+    }
+
+    const int fc = from.y * width + from.x;
+    const int tc = to.y * width + to.x;
+    const int from_chunk = chunk_of(fc);
+    const int to_chunk = chunk_of(tc);
+
+    std::vector<int> cells{ fc };
+    auto emit = [&]() {
+        for (int c : cells) {
+            path.push_back(ivec2{ c % width, c / width });
+        }
+        return true;
+    };
+
+    if (from_chunk == to_chunk && local_path(s, from_chunk, fc, tc, cells)) {
+        return emit();
+    }
+
+    // a recent route between the same chunks only needs the ends joined up
+    const uint64_t key = ((uint64_t)from_chunk << 32) | (uint32_t)to_chunk;
+    auto cached = s.route_of_key.find(key);
+    if (cached != s.route_of_key.end()) {
+        PathSearch::Route& r = *cached->second;
+        if (route_valid(r) &&
+            local_path(s, from_chunk, fc, r.first, cells))
+        {
+            size_t joined = cells.size();
+            cells.insert(cells.end(), r.cells.begin(), r.cells.end());
+            if (local_path(s, to_chunk, r.last, tc, cells)) {
+                s.routes.splice(s.routes.begin(), s.routes, cached->second);
+                return emit();
+            }
+            cells.resize(joined);
+        }
+        cells.resize(1);
+    }
+
+    std::vector<int> waypoints;
+    if (!abstract_search(s, fc, tc, waypoints)) {
+        return false;
+    }
+
+    // refine, steps across a border are one tile and everything else stays in a chunk
+    local_path(s, from_chunk, fc, node(waypoints.front()).cell, cells);
+    size_t middle = cells.size();
+    for (size_t i = 1; i < waypoints.size(); i++) {
+        const PathNode& a = node(waypoints[i - 1]);
+        const PathNode& b = node(waypoints[i]);
+        if (a.chunk == b.chunk) {
+            local_path(s, a.chunk, a.cell, b.cell, cells);
+        }
+        else {
+            cells.push_back(b.cell);
+        }
+    }
+    size_t middle_end = cells.size();
+    local_path(s, to_chunk, node(waypoints.back()).cell, tc, cells);
+
+    PathSearch::Route r;
+    r.key = key;
+    r.first = node(waypoints.front()).cell;
+    r.last = node(waypoints.back()).cell;
+    r.cells.assign(cells.begin() + middle, cells.begin() + middle_end);
+    std::vector<int> touched{ chunk_of(r.first) };
+    for (int c : r.cells) {
+        touched.push_back(chunk_of(c));
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (int c : touched) {
+        r.chunks.emplace_back(c, versions[c]);
+    }
+
+    if (cached != s.route_of_key.end()) {
+        s.routes.erase(cached->second);
+        s.route_of_key.erase(cached);
+    }
+    s.routes.push_front(std::move(r));
+    s.route_of_key[key] = s.routes.begin();
+    if (s.routes.size() > ROUTE_CAPACITY) {
+        s.route_of_key.erase(s.routes.back().key);
+        s.routes.pop_back();
+    }
+
+    return emit();
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "pse/pse.hpp"
+
+struct PathLink {
+    int to; // node
+    int cost; // tiles
+};
+
+// an entrance between two chunks, there is one on either side of the border
+struct PathNode {
+    int cell; // tile index, wy * width + wx
+    int chunk;
+    int borders; // number of borders using it, deleted at 0
+    std::vector<PathLink> intra; // to nodes in the same chunk
+    std::vector<PathLink> inter; // to nodes across a border
+    bool alive;
+};
+
+/* What searches read of one chunk. Chunks are shared with snapshots and
+   copied before they're written to while one still has them. */
+struct PathChunk {
+    pse::bitgrid blocked{}; // chunk_size x chunk_size, set where it isn't walkable or is off the map
+    std::vector<PathNode> nodes{}; // entrances, node ids are chunk * node_stride + index, dead ones are reused
+};
+
+// working memory for searching, every thread that searches needs its own
+struct PathSearch {
+    // searches inside of one chunk
+    std::vector<int> local_dist{};
+    std::vector<int> local_from{};
+    std::vector<int> local_queue{};
+
+    // searches over the entrances, stamped instead of cleared
+    std::vector<int> search_g{};
+    std::vector<int> search_parent{};
+    std::vector<unsigned> search_stamp{};
+    std::vector<int> goal_cost{};
+    std::vector<unsigned> goal_stamp{};
+    unsigned stamp = 0;
+
+    // routes between entrances, keyed by start and goal chunk
+    struct Route {
+        uint64_t key;
+        int first; // cells the route starts and ends on
+        int last;
+        std::vector<int> cells;
+        std::vector<std::pair<int, unsigned>> chunks; // chunk and its version when the route was found
+    };
+    std::list<Route> routes{}; // most recently used first
+    std::unordered_map<uint64_t, std::list<Route>::iterator> route_of_key{};
+};
+
+/**
+ * Hierarchical A* over the walkable tiles. Chunks are connected by entrances
+ * along their borders and each chunk knows the cost between its own entrances,
+ * so a search only walks tiles inside of the chunks at either end.
+ *
+ * Edits mark chunks dirty, dirty chunks and their neighbours are rebuilt on
+ * the next search. Recent routes are cached by start and goal chunk and stay
+ * valid until a chunk they pass through changes.
+ *
+ * A snapshot shares every chunk, so taking one after an edit only costs
+ * copies of the chunks the edit rebuilt. It can be searched but not edited.
+ */
+class PathFinder {
+public:
+    void resize(int width, int height, int chunk_size);
+    void set_walkable(int wx, int wy, int w, int h, bool walkable); // rect must be in bounds
+    bool walkable(int wx, int wy) const;
+    const pse::bitgrid& chunk_walls(int chunk) const; // chunk_size x chunk_size, set on every tile that isn't walkable
+    bool find(pse::ivec2 from, pse::ivec2 to, std::vector<pse::ivec2>& path); // path includes both ends
+    bool find(pse::ivec2 from, pse::ivec2 to, std::vector<pse::ivec2>& path, PathSearch& search) const; // needs rebuild first
+    void rebuild(); // bring dirty chunks up to date, the first find does this itself
+    unsigned revision() const; // changes on every edit
+    std::shared_ptr<const PathFinder> snapshot(); // rebuilt, shares its chunks, other threads can search it
+    unsigned chunk_version(int chunk) const; // changes when the chunk's walkability does
+    int chunk_of(int cell) const;
+    int width = 0;
+    int height = 0;
+    int chunk_size = 0;
+    int chunks_wide = 0;
+    int chunks_tall = 0;
+private:
+    std::vector<std::shared_ptr<PathChunk>> chunks{};
+    int node_stride = 0; // most entrances a chunk can have
+    std::vector<unsigned> versions{};
+    unsigned edits = 0;
+
+    // only for editing, snapshots leave these empty
+    std::unordered_map<int, int> node_of_cell{};
+    std::vector<std::vector<int>> border_nodes{}; // entrance pairs on each border, 2 per chunk: east then south
+    std::vector<char> dirty{};
+    std::vector<int> dirty_list{};
+    PathSearch search{}; // for the calling thread
+
+    const PathNode& node(int id) const;
+    PathChunk& chunk_write(int chunk); // copies the chunk first while a snapshot has it
+    PathNode& node_write(int id);
+    int node_new(int cell);
+    void node_release(int node);
+    void border_clear(int border);
+    void border_build(int border);
+    void chunk_link(int chunk);
+    void local_search(PathSearch& s, int chunk, int from) const; // fills local_dist/local_from for the chunk
+    bool local_path(PathSearch& s, int chunk, int from, int to, std::vector<int>& cells) const; // appends, excluding from
+    bool abstract_search(PathSearch& s, int from, int to, std::vector<int>& waypoints) const;
+    bool route_valid(const PathSearch::Route& r) const;
+};
@@ -0,0 +1,142 @@
+#include <algorithm>
+
+#include "path_service.hpp"
+
+using namespace pse;
+
+// searches handed to a worker at once
+constexpr size_t PATH_BATCH = 64;
+
+static inline uint64_t query_key(ivec2 from, ivec2 to)
+{
+    return ((uint64_t)(uint16_t)from.x << 48) | ((uint64_t)(uint16_t)from.y << 32) |
+           ((uint64_t)(uint16_t)to.x << 16) | (uint64_t)(uint16_t)to.y;
+}
+
+PathService::PathService(pool& workers)
+: workers{workers}
+{
+
+}
+
+PathService::~PathService()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this]() { return running == 0; });
+}
+
+PathTicket PathService::submit(ivec2 from, ivec2 to)
+{
+    PathTicket ticket = next_ticket++;
+    if (next_ticket == 0) {
+        next_ticket = 1;
+    }
+    waiting.insert(ticket);
+
+    uint64_t key = query_key(from, to);
+    auto it = jobs.find(key);
+    if (it != jobs.end()) {
+        it->second->tickets.push_back(ticket);
+        return ticket;
+    }
+
+    Job *job = new Job{ key, from, to, { ticket }, false, {} };
+    jobs[key] = std::unique_ptr<Job>(job);
+    queued.push_back(job);
+    return ticket;
+}
+
+void PathService::cancel(PathTicket ticket)
+{
+    waiting.erase(ticket);
+    results.erase(ticket);
+}
+
+PathStatus PathService::take(PathTicket ticket, std::vector<ivec2>& path)
+{
+    auto it = results.find(ticket);
+    if (it == results.end()) {
+        return waiting.count(ticket) ? PATH_PENDING : PATH_UNKNOWN;
+    }
+    bool found = it->second.found;
+    path = std::move(it->second.path);
+    results.erase(it);
+    return found ? PATH_FOUND : PATH_NONE;
+}
+
+void PathService::run(std::shared_ptr<const PathFinder> finder, std::vector<Job *> batch)
+{
+    std::unique_ptr<PathSearch> search;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!spare.empty()) {
+            search = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    if (!search) {
+        search.reset(new PathSearch{});
+    }
+
+    for (Job *job : batch) {
+        job->found = finder->find(job->from, job->to, job->path, *search);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    spare.push_back(std::move(search));
+    finished.insert(finished.end(), batch.begin(), batch.end());
+    running--;
+    idle.notify_all();
+}
+
+void PathService::update(PathFinder& live)
+{
+    frame_vector<Job *> done;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done.assign(finished.begin(), finished.end());
+        finished.clear();
+    }
+    for (Job *job : done) {
+        for (PathTicket t : job->tickets) {
+            if (waiting.erase(t)) {
+                results[t] = Result{ job->found, job->path };
+            }
+        }
+        jobs.erase(job->key);
+    }
+
+    // queries everyone gave up on never start
+    frame_vector<Job *> start;
+    while (!queued.empty() && (int)start.size() < searches_per_frame) {
+        Job *job = queued.front();
+        queued.pop_front();
+        bool wanted = std::any_of(job->tickets.begin(), job->tickets.end(),
+            [this](PathTicket t) { return waiting.count(t) != 0; });
+        if (wanted) {
+            start.push_back(job);
+        }
+        else {
+            jobs.erase(job->key);
+        }
+    }
+    if (start.empty()) {
+        return;
+    }
+
+    if (!snapshot || snapshot->revision() != live.revision()) {
+        snapshot = live.snapshot();
+    }
+
+    std::stable_sort(start.begin(), start.end(), [](const Job *a, const Job *b) {
+        return a->to.y < b->to.y || (a->to.y == b->to.y && a->to.x < b->to.x);
+    });
+    for (size_t i = 0; i < start.size(); i += PATH_BATCH) {
+        std::vector<Job *> batch(start.begin() + i, start.begin() + std::min(i + PATH_BATCH, start.size()));
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running++;
+        }
+        workers.submit([this, finder = snapshot, batch]() { run(finder, batch); });
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "pse/pse.hpp"
+#include "path.hpp"
+
+typedef unsigned PathTicket; // 0 is never handed out
+
+enum PathStatus {
+    PATH_PENDING, // not delivered yet
+    PATH_FOUND,
+    PATH_NONE,    // there is no path
+    PATH_UNKNOWN, // never submitted, cancelled or already taken
+};
+
+/**
+ * Answers path queries on the worker threads instead of inside update.
+ * Queries with the same ends share one search, and searches are batched
+ * by goal so each worker keeps reusing its cached routes into it. Workers
+ * search a read only snapshot of the pathfinder taken at the frame boundary,
+ * so edits during the frame never race them.
+ *
+ * Answers are handed out by update once per frame, and only so many
+ * searches start each frame so a burst of queries spreads over frames.
+ */
+class PathService {
+public:
+    PathService(pse::pool& workers);
+    ~PathService(); // waits for running searches
+    PathTicket submit(pse::ivec2 from, pse::ivec2 to);
+    void cancel(PathTicket ticket);
+    PathStatus take(PathTicket ticket, std::vector<pse::ivec2>& path); // forgets the ticket once delivered
+    void update(PathFinder& live); // deliver finished searches and start queued ones
+    int searches_per_frame = 2048;
+private:
+    struct Job {
+        uint64_t key;
+        pse::ivec2 from;
+        pse::ivec2 to;
+        std::vector<PathTicket> tickets; // main thread only
+        bool found; // written by the worker
+        std::vector<pse::ivec2> path;
+    };
+    struct Result {
+        bool found;
+        std::vector<pse::ivec2> path;
+    };
+
+    pse::pool& workers;
+    std::shared_ptr<const PathFinder> snapshot{};
+    PathTicket next_ticket = 1;
+    std::unordered_map<uint64_t, std::unique_ptr<Job>> jobs{}; // queued or running, by start and goal
+    std::deque<Job *> queued{};
+    std::unordered_set<PathTicket> waiting{};
+    std::unordered_map<PathTicket, Result> results{};
+
+    // shared with the workers
+    std::mutex lock{};
+    std::condition_variable idle{};
+    std::vector<Job *> finished{};
+    std::vector<std::unique_ptr<PathSearch>> spare{}; // search memory not in use
+    int running = 0; // batches
+
+    void run(std::shared_ptr<const PathFinder> finder, std::vector<Job *> batch);
+};
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef PSE_ALLOC_TRACK
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void *__libc_memalign(size_t align, size_t size);
+extern "C" void __libc_free(void *p);
+#elif defined(_WIN32)
+#include <intrin.h>
+#include <malloc.h>
+#endif
+#endif
+
+#include "alloc.hpp"
+
+namespace pse {
+
+static thread_local const char *zone = nullptr;
+
+alloc_zone::alloc_zone(const char *name)
+: outer{zone}
+{
+    zone = name;
+}
+
+alloc_zone::~alloc_zone()
+{
+    zone = outer;
+}
+
+const char *alloc_zone_name()
+{
+    return zone;
+}
+
+static bool reporting = false;
+static size_t warmup_frames = 0;
+static size_t frames = 0;
+
+void alloc_track(bool report, size_t warmup)
+{
+    reporting = report;
+    warmup_frames = warmup;
+}
+
+#ifndef PSE_ALLOC_TRACK
+
+bool alloc_tracking()
+{
+    return false;
+}
+
+alloc_stats alloc_frame()
+{
+    return alloc_stats{0, 0};
+}
+
+void alloc_frame_end()
+{
+    frames++;
+}
+
+#else
+
+constexpr int PSE_ALLOC_ZONES = 64;
+
+/* Tables are filled in from any thread as allocations are made, so
+   they're fixed size and claimed with a compare and swap on the key. */
+struct alloc_entry {
+    std::atomic<uintptr_t> key; // 0 while it's free
+    std::atomic<uint64_t> count; // this frame
+    std::atomic<uint64_t> bytes;
+    std::atomic<const char *> zone; // for sites, the one it was last called in
+};
+
+static alloc_entry sites[PSE_ALLOC_SITES];
+static alloc_entry zones[PSE_ALLOC_ZONES];
+static std::atomic<uint64_t> frame_count{0}; // in a zone, what the frame itself made
+static std::atomic<uint64_t> frame_bytes{0};
+static std::atomic<uint64_t> unzoned_count{0}; // threads outside any zone, like workers and writers
+static std::atomic<uint64_t> unzoned_bytes{0};
+static thread_local bool inside = false; // reporting, what that allocates isn't counted
+static const char outside[] = "no zone";
+
+static alloc_entry& entry(alloc_entry *table, int size, uintptr_t key)
+{
+    size_t h = (size_t)((key >> 4) * 0x9e3779b97f4a7c15ull);
+    for (int probe = 0; probe < size; probe++) {
+        alloc_entry& e = table[(h + probe) % size];
+        uintptr_t k = e.key.load(std::memory_order_acquire);
+        if (k == key) {
+            return e;
+        }
+        if (k == 0 && (e.key.compare_exchange_strong(k, key) || k == key)) {
+            return e;
+        }
+    }
+    return table[size - 1];
+}
+
+static void record(void *caller, size_t size)
+{
+    if (inside) {
+        return;
+    }
+    const char *z = zone ? zone : outside;
+    if (zone) {
+        frame_count.fetch_add(1, std::memory_order_relaxed);
+        frame_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    else {
+        unzoned_count.fetch_add(1, std::memory_order_relaxed);
+        unzoned_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    alloc_entry& s = entry(sites, PSE_ALLOC_SITES, (uintptr_t)caller);
+    s.count.fetch_add(1, std::memory_order_relaxed);
+    s.bytes.fetch_add(size, std::memory_order_relaxed);
+    s.zone.store(z, std::memory_order_relaxed);
+    alloc_entry& e = entry(zones, PSE_ALLOC_ZONES, (uintptr_t)z);
+    e.count.fetch_add(1, std::memory_order_relaxed);
+    e.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+bool alloc_tracking()
+{
+    return true;
+}
+
+alloc_stats alloc_frame()
+{
+    return alloc_stats{frame_count.load(), frame_bytes.load()};
+}
+
+static void site_print(const alloc_entry& s)
+{
+    void *caller = (void *)s.key.load();
+    const char *where = "?";
+    uintptr_t offset = 0;
+#if defined(__GLIBC__)
+    Dl_info info;
+    if (dladdr(caller, &info) && info.dli_sname) {
+        where = info.dli_sname;
+        offset = (uintptr_t)caller - (uintptr_t)info.dli_saddr;
+    }
+    else if (dladdr(caller, &info)) {
+        offset = (uintptr_t)caller - (uintptr_t)info.dli_fbase; // for addr2line
+    }
+#endif
+    fprintf(stderr, "  %p %s+0x%llx in %s: %llu, %llu bytes\n", caller, where, (unsigned long long)offset,
+        s.zone.load(), (unsigned long long)s.count.load(), (unsigned long long)s.bytes.load());
+}
+
+void alloc_frame_end()
+{
+    inside = true;
+    const size_t frame = frames++;
+    const uint64_t count = frame_count.exchange(0);
+    const uint64_t bytes = frame_bytes.exchange(0);
+    const uint64_t unzoned = unzoned_count.exchange(0);
+    const uint64_t unzoned_size = unzoned_bytes.exchange(0);
+    // what other threads make on their own isn't the frame's
+    const bool failed = warmup_frames > 0 && frame >= warmup_frames && count > 0;
+
+    if ((reporting || failed) && count + unzoned > 0) {
+        fprintf(stderr, "Allocations: frame %zu made %llu, %llu bytes, other threads %llu, %llu bytes\n", frame,
+            (unsigned long long)count, (unsigned long long)bytes, (unsigned long long)unzoned, (unsigned long long)unzoned_size);
+        for (const alloc_entry& z : zones) {
+            if (z.count.load() > 0) {
+                fprintf(stderr, "  %s: %llu, %llu bytes\n", (const char *)z.key.load(),
+                    (unsigned long long)z.count.load(), (unsigned long long)z.bytes.load());
+            }
+        }
+        static int order[PSE_ALLOC_SITES];
+        int n = 0;
+        for (int i = 0; i < PSE_ALLOC_SITES; i++) {
+            if (sites[i].count.load() > 0) {
+                order[n++] = i;
+            }
+        }
+        int top = std::min(n, PSE_ALLOC_TOP);
+        std::partial_sort(order, order + top, order + n, [](int a, int b) { return sites[a].count.load() > sites[b].count.load(); });
+        for (int i = 0; i < top; i++) {
+            site_print(sites[order[i]]);
+        }
+    }
+    for (alloc_entry& s : sites) {
+        s.count = 0;
+        s.bytes = 0;
+    }
+    for (alloc_entry& z : zones) {
+        z.count = 0;
+        z.bytes = 0;
+    }
+    inside = false;
+
+    if (failed) {
+        fprintf(stderr, "Error: Frame %zu allocated after %zu frames of warming up\n", frame, warmup_frames);
+        abort();
+    }
+}
+
+#endif
+
+} // pse
+
+#ifdef PSE_ALLOC_TRACK
+
+#if defined(__GNUC__)
+#define PSE_ALLOC_CALLER __builtin_return_address(0)
+#elif defined(_MSC_VER)
+#define PSE_ALLOC_CALLER _ReturnAddress()
+#else
+#define PSE_ALLOC_CALLER nullptr
+#endif
+
+// malloc itself can only be hooked where the allocator underneath can still be reached
+#if defined(__GLIBC__)
+#define PSE_ALLOC_MALLOC __libc_malloc
+#define PSE_ALLOC_FREE __libc_free
+
+extern "C" void *malloc(size_t size)
+{
+    pse::record(PSE_ALLOC_CALLER, size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    pse::record(PSE_ALLOC_CALLER, n * size);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+    pse::record(PSE_ALLOC_CALLER, size);
+    return __libc_realloc(p, size);
+}
+#else
+#define PSE_ALLOC_MALLOC std::malloc
+#define PSE_ALLOC_FREE std::free
+#endif
+
+static void *aligned_get(size_t size, size_t align)
+{
+#if defined(__GLIBC__)
+    return __libc_memalign(align, size);
+#elif defined(_WIN32)
+    return _aligned_malloc(size, align);
+#else
+    void *p = nullptr;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+#endif
+}
+
+static void aligned_put(void *p)
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    PSE_ALLOC_FREE(p);
+#endif
+}
+
+static void *new_get(void *caller, size_t size)
+{
+    pse::record(caller, size);
+    void *p = PSE_ALLOC_MALLOC(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+static void *new_get(void *caller, size_t size, std::align_val_t align)
+{
+    pse::record(caller, size);
+    void *p = aligned_get(size ? size : 1, (size_t)align);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(size_t size) { return new_get(PSE_ALLOC_CALLER, size); }
+void *operator new[](size_t size) { return new_get(PSE_ALLOC_CALLER, size); }
+void *operator new(size_t size, std::align_val_t align) { return new_get(PSE_ALLOC_CALLER, size, align); }
+void *operator new[](size_t size, std::align_val_t align) { return new_get(PSE_ALLOC_CALLER, size, align); }
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    pse::record(PSE_ALLOC_CALLER, size);
+    return PSE_ALLOC_MALLOC(size ? size : 1);
+}
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    pse::record(PSE_ALLOC_CALLER, size);
+    return PSE_ALLOC_MALLOC(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept { PSE_ALLOC_FREE(p); }
+void operator delete[](void *p) noexcept { PSE_ALLOC_FREE(p); }
+void operator delete(void *p, size_t) noexcept { PSE_ALLOC_FREE(p); }
+void operator delete[](void *p, size_t) noexcept { PSE_ALLOC_FREE(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { PSE_ALLOC_FREE(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { PSE_ALLOC_FREE(p); }
+void operator delete(void *p, std::align_val_t) noexcept { aligned_put(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { aligned_put(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { aligned_put(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { aligned_put(p); }
+
+#endif
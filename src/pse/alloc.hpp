@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Built with PSE_ALLOC_TRACK defined, every allocation made with new or
+   malloc is counted against the frame it's made in, the zone the thread
+   is in and where it was called from. Only allocations made in a zone are
+   the frame's, those of threads outside any, like workers running jobs on
+   their own, are reported apart and never fail it. Without it none of
+   this does anything and the allocators are left alone. */
+
+namespace pse {
+
+constexpr int PSE_ALLOC_SITES = 1024; // call sites told apart, any more are put down to the last
+constexpr int PSE_ALLOC_TOP = 8; // call sites listed in a report
+
+/**
+ * Allocations made on this thread while it lives are put down to name,
+ * zones nest and the innermost one counts
+ */
+struct alloc_zone {
+    const char *outer;
+
+    alloc_zone(const char *name);
+    ~alloc_zone();
+};
+
+const char *alloc_zone_name(); // this thread's, nullptr outside any
+
+struct alloc_stats {
+    uint64_t count;
+    uint64_t bytes;
+};
+
+bool alloc_tracking(); // false unless it was built in
+void alloc_track(bool report, size_t warmup); // report frames that allocate, and past warmup frames one that does fails, 0 for never
+alloc_stats alloc_frame(); // so far this frame, in a zone
+void alloc_frame_end(); // checks and reports the frame, then counts the next one
+
+} // pse
@@ -0,0 +1,114 @@
+#include <algorithm>
+
+#include "arena.hpp"
+
+namespace pse {
+
+arena::arena()
+{
+
+}
+
+void *arena::alloc(size_t size, size_t align)
+{
+    uintptr_t p = ((uintptr_t)top + align - 1) & ~(uintptr_t)(align - 1);
+    if (!top || p + size > (uintptr_t)end) {
+        grow(size + align);
+        p = ((uintptr_t)top + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    top = (char *)(p + size);
+    return (void *)p;
+}
+
+void arena::free(void *p, size_t size)
+{
+    // scratch freed in the reverse of the order it was made, as locals are, all comes back
+    if ((char *)p + size == top) {
+        top = (char *)p;
+    }
+}
+
+void arena::grow(size_t size)
+{
+    size = std::max(size, PSE_ARENA_BLOCK);
+    if (!blocks.empty()) {
+        size = std::max(size, blocks.back().size * 2);
+    }
+    blocks.push_back(block{ std::unique_ptr<char[]>(new char[size]), size });
+    top = blocks.back().data.get();
+    end = top + size;
+}
+
+void arena::reset()
+{
+    if (blocks.size() > 1) {
+        size_t size = capacity();
+        blocks.clear();
+        blocks.push_back(block{ std::unique_ptr<char[]>(new char[size]), size });
+    }
+    top = blocks.empty() ? nullptr : blocks[0].data.get();
+    end = blocks.empty() ? nullptr : top + blocks[0].size;
+}
+
+size_t arena::capacity() const
+{
+    size_t size = 0;
+    for (const block& b : blocks) {
+        size += b.size;
+    }
+    return size;
+}
+
+static std::atomic<uint64_t> arenas_made{0};
+static frame_arenas *current = nullptr;
+
+frame_arenas::frame_arenas()
+: id{++arenas_made}
+{
+
+}
+
+frame_arenas::~frame_arenas()
+{
+    if (current == this) {
+        current = nullptr;
+    }
+}
+
+arena& frame_arenas::local()
+{
+    thread_local uint64_t mine = 0;
+    thread_local slot *own = nullptr;
+    if (mine != id) {
+        std::lock_guard<std::mutex> guard(lock);
+        slots.push_back(std::unique_ptr<slot>(new slot{}));
+        own = slots.back().get();
+        mine = id;
+    }
+    uint64_t now = epoch.load(std::memory_order_acquire);
+    if (own->epoch != now) {
+        own->scratch.reset();
+        own->epoch = now;
+    }
+    return own->scratch;
+}
+
+void frame_arenas::reset()
+{
+    epoch.fetch_add(1, std::memory_order_release);
+    local();
+}
+
+void frame_arenas::make_current()
+{
+    current = this;
+}
+
+arena& frame_arena()
+{
+    // without a context nothing starts frames, memory only comes back as it's freed
+    static frame_arenas standalone;
+    return (current ? current : &standalone)->local();
+}
+
+} // pse
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pse {
+
+constexpr size_t PSE_ARENA_BLOCK = 64 * 1024; // least an arena takes from the heap at once
+
+/**
+ * Bump allocator for memory that only lives until the end of a frame.
+ * Allocating moves a pointer along, freeing only gives memory back if
+ * it was the last allocated, and reset takes everything back at once.
+ * Blocks are kept over a reset, merged into one if it took more than
+ * one, so once frames stop growing nothing is taken from the heap.
+ */
+struct arena {
+    struct block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+    std::vector<block> blocks{};
+    char *top = nullptr; // next free byte of the last block
+    char *end = nullptr;
+
+    arena();
+    void *alloc(size_t size, size_t align);
+    void free(void *p, size_t size);
+    void reset(); // everything allocated is gone
+    size_t capacity() const;
+private:
+    void grow(size_t size);
+};
+
+/**
+ * The per-frame arenas a context owns, one for each thread that asks.
+ * After its first time a thread finds its own without locking, and each
+ * is emptied the first time it's used in a frame, so starting a frame
+ * never reaches into another thread.
+ */
+class frame_arenas {
+public:
+    frame_arenas();
+    ~frame_arenas();
+    frame_arenas(const frame_arenas&) = delete;
+    frame_arenas& operator=(const frame_arenas&) = delete;
+    arena& local(); // the calling thread's, emptied the first time it's used in each frame
+    void reset(); // starts a new frame for every thread's arena, the caller's is emptied now
+    void make_current(); // the ones frame_arena hands out
+private:
+    struct slot {
+        arena scratch;
+        uint64_t epoch = 0;
+    };
+
+    const uint64_t id; // never the same twice, a thread's own is found by it
+    std::atomic<uint64_t> epoch{0};
+    std::mutex lock{};
+    std::vector<std::unique_ptr<slot>> slots{};
+};
+
+arena& frame_arena(); // this thread's, from the current frame_arenas, see context::frames
+
+/**
+ * Standard library allocator out of an arena, this thread's frame arena
+ * unless it's given one. It stays with the arena it was made for, so
+ * whatever uses it has to grow on the thread that made it.
+ */
+template <typename T>
+struct arena_allocator {
+    typedef T value_type;
+    arena *from;
+
+    arena_allocator() : from{&frame_arena()} {}
+    arena_allocator(arena& a) : from{&a} {}
+    template <typename U> arena_allocator(const arena_allocator<U>& other) : from{other.from} {}
+    T *allocate(size_t n)
+    {
+        return (T *)from->alloc(n * sizeof(T), alignof(T));
+    }
+    void deallocate(T *p, size_t n)
+    {
+        from->free(p, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.from == b.from;
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.from != b.from;
+}
+
+// scratch that's gone by the next frame, never keep one longer
+template <typename T>
+using frame_vector = std::vector<T, arena_allocator<T>>;
+
+} // pse
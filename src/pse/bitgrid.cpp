@@ -0,0 +1,148 @@
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PSE_BITGRID_SSE2
+#endif
+
+#include "bitgrid.hpp"
+
+namespace pse {
+
+bitgrid::bitgrid()
+{
+
+}
+
+bitgrid::bitgrid(int w, int h)
+{
+    resize(w, h);
+}
+
+void bitgrid::resize(int w, int h)
+{
+    width = w;
+    height = h;
+    words_per_row = (w + 63) / 64;
+    words.assign((size_t)words_per_row * h, 0);
+}
+
+bool bitgrid::get(int x, int y) const
+{
+    return (words[(size_t)y * words_per_row + x / 64] >> (x % 64)) & 1;
+}
+
+void bitgrid::set(int x, int y, bool value)
+{
+    uint64_t& word = words[(size_t)y * words_per_row + x / 64];
+    uint64_t bit = 1ULL << (x % 64);
+    word = value ? (word | bit) : (word & ~bit);
+}
+
+/**
+ * Are any bits set in n whole words, wide footprints
+ * are tested 128 bits at a time
+ */
+static inline bool any_words(const uint64_t *p, int n)
+{
+    int k = 0;
+#ifdef PSE_BITGRID_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (; k + 2 <= n; k += 2) {
+        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(p + k)));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) {
+        return true;
+    }
+#endif
+    uint64_t rest = 0;
+    for (; k < n; k++) {
+        rest |= p[k];
+    }
+    return rest != 0;
+}
+
+bool bitgrid::any_rect(int x, int y, int w, int h) const
+{
+    if (w <= 0 || h <= 0) {
+        return false;
+    }
+
+    const int w0 = x / 64;
+    const int w1 = (x + w - 1) / 64;
+    const uint64_t first = ~0ULL << (x % 64);
+    const uint64_t last = ~0ULL >> (63 - (x + w - 1) % 64);
+
+    for (int i = y; i < y + h; i++) {
+        const uint64_t *row = &words[(size_t)i * words_per_row];
+        if (w0 == w1) {
+            if (row[w0] & first & last) {
+                return true;
+            }
+            continue;
+        }
+        if ((row[w0] & first) || (row[w1] & last) || any_words(row + w0 + 1, w1 - w0 - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void bitgrid::fill_rect(int x, int y, int w, int h, bool value)
+{
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    const int w0 = x / 64;
+    const int w1 = (x + w - 1) / 64;
+    const uint64_t first = ~0ULL << (x % 64);
+    const uint64_t last = ~0ULL >> (63 - (x + w - 1) % 64);
+
+    for (int i = y; i < y + h; i++) {
+        uint64_t *row = &words[(size_t)i * words_per_row];
+        for (int k = w0; k <= w1; k++) {
+            uint64_t mask = ~0ULL;
+            if (k == w0) mask &= first;
+            if (k == w1) mask &= last;
+            row[k] = value ? (row[k] | mask) : (row[k] & ~mask);
+        }
+    }
+}
+
+/**
+ * Searches outwards in square rings around near, the
+ * first rect found is the closest one to being centered on it
+ */
+bool bitgrid::find_clear_rect(int w, int h, int near_x, int near_y, int radius, ivec2& out) const
+{
+    const int cx = near_x - w / 2;
+    const int cy = near_y - h / 2;
+
+    auto try_at = [&](int x, int y) {
+        if (x < 0 || y < 0 || x + w > width || y + h > height) {
+            return false;
+        }
+        if (any_rect(x, y, w, h)) {
+            return false;
+        }
+        out = ivec2{x, y};
+        return true;
+    };
+
+    for (int r = 0; r <= radius; r++) {
+        for (int d = -r; d <= r; d++) {
+            if (try_at(cx + d, cy - r) || try_at(cx + d, cy + r)) {
+                return true;
+            }
+        }
+        for (int d = -r + 1; d <= r - 1; d++) {
+            if (try_at(cx - r, cy + d) || try_at(cx + r, cy + d)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // pse
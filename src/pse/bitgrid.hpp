@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+
+namespace pse {
+
+/**
+ * 2D grid of bits. Every row starts on a new word, so threads
+ * writing different rows never share a word.
+ */
+struct bitgrid {
+    int width = 0;
+    int height = 0;
+    int words_per_row = 0;
+    std::vector<uint64_t> words{};
+
+    bitgrid();
+    bitgrid(int w, int h);
+    void resize(int w, int h); // all bits are cleared
+    bool get(int x, int y) const;
+    void set(int x, int y, bool value);
+    void fill_rect(int x, int y, int w, int h, bool value); // rect must be in bounds
+    bool any_rect(int x, int y, int w, int h) const; // is any bit set, rect must be in bounds
+    bool find_clear_rect(int w, int h, int near_x, int near_y, int radius, ivec2& out) const; // closest w x h rect without any bits set
+};
+
+} // pse
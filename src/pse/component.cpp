@@ -2,32 +2,131 @@
 
 namespace pse {
 
-component::component()
+component_pool::component_pool()
 {
 
 }
 
-component::component(int x, int y, int w, int h)
-: x{x}, y{y}, w{w}, h{h},
-  mouse_hovering{false}, mouse_pressing{false}, mouse_pressed{false}, focused{false}
+component component_pool::add(int x, int y, int w, int h)
 {
+    uint32_t index;
+    if (!free_slots.empty()) {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+    else {
+        index = (uint32_t)slots.size();
+        slots.push_back(slot{0, -1});
+    }
+    slot& s = slots[index];
+    s.generation++;
+    if (s.generation == 0) {
+        s.generation = 1;
+    }
+    s.row = (int)rects.size();
+    rects.push_back(SDL_Rect{x, y, w, h});
+    states.push_back(0);
+    owners.push_back(index);
+    return component{index, s.generation};
+}
 
+void component_pool::remove(component c)
+{
+    if (!alive(c)) {
+        return;
+    }
+    slot& s = slots[c.index];
+    states[s.row] = COMPONENT_REMOVED;
+    s.row = -1;
+    free_slots.push_back(c.index);
+    removed++;
+}
+
+bool component_pool::alive(component c) const
+{
+    return c.index < slots.size() && slots[c.index].generation == c.generation && slots[c.index].row != -1;
 }
 
-bool component::within(ivec2 coords)
+size_t component_pool::size() const
 {
-    return (coords.x <= x + w &&
-            coords.x > x &&
-            coords.y <= y + h &&
-            coords.y > y);
+    return rects.size() - removed;
 }
 
-void component::reset_focus()
+SDL_Rect *component_pool::rect(component c)
 {
-    mouse_hovering = false;
-    mouse_pressing = false;
-    mouse_pressed = false;
-    focused = false;
+    return alive(c) ? &rects[slots[c.index].row] : nullptr;
+}
+
+unsigned component_pool::flags(component c) const
+{
+    return alive(c) ? states[slots[c.index].row] : 0;
+}
+
+/**
+ * Removed rows are dropped and the rest keep their order, a slot
+ * that was reused in the meantime already points at its new row
+ */
+void component_pool::pack()
+{
+    size_t to = 0;
+    for (size_t from = 0; from < rects.size(); from++) {
+        if (states[from] & COMPONENT_REMOVED) {
+            continue;
+        }
+        rects[to] = rects[from];
+        states[to] = states[from];
+        owners[to] = owners[from];
+        slots[owners[to]].row = (int)to;
+        to++;
+    }
+    rects.resize(to);
+    states.resize(to);
+    owners.resize(to);
+    removed = 0;
+}
+
+void component_pool::focus(ivec2 mouse, bool lclick)
+{
+    if (removed > size() + PSE_COMPONENT_SLACK) {
+        pack();
+    }
+
+    const int n = (int)rects.size();
+    for (int i = 0; i < n; i++) {
+        const uint8_t state = states[i];
+        if (state & (COMPONENT_FOCUSED | COMPONENT_REMOVED)) {
+            continue;
+        }
+        const SDL_Rect& r = rects[i];
+
+        // determine focus
+        bool hovering = mouse.x <= r.x + r.w && mouse.x > r.x && mouse.y <= r.y + r.h && mouse.y > r.y;
+        bool pressing = hovering && lclick;
+        bool pressed = state & COMPONENT_PRESSED;
+        bool focused = false;
+        // component started being pressed on / positive edge of click
+        if (pressing && !pressed) {
+            pressed = true;
+        }
+        // the mouse leaves the bounds
+        if (!hovering) {
+            pressed = false;
+        }
+        // negative edge of click
+        if (pressed && hovering && !lclick) {
+            pressed = false;
+            focused = true;
+        }
+        states[i] = (hovering ? COMPONENT_HOVERING : 0) | (pressing ? COMPONENT_PRESSING : 0) |
+                    (pressed ? COMPONENT_PRESSED : 0) | (focused ? COMPONENT_FOCUSED : 0);
+    }
+
+    // reset focus on all panels beneath the top one
+    for (int i = n - 1; i >= 0; i--) {
+        if (states[i] & COMPONENT_FOCUSED) {
+            states[i] = 0;
+        }
+    }
 }
 
-} // pse
\ No newline at end of file
+} // pse
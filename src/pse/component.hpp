@@ -1,23 +1,61 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "types.hpp"
 
 namespace pse {
 
+// rects removed before the arrays are packed again, past as many as are in use
+#define PSE_COMPONENT_SLACK 64
+
+enum component_flag {
+    COMPONENT_HOVERING = 1 << 0,
+    COMPONENT_PRESSING = 1 << 1,
+    COMPONENT_PRESSED = 1 << 2,
+    COMPONENT_FOCUSED = 1 << 3, // invisible
+    COMPONENT_REMOVED = 1 << 4,
+};
+
 struct component {
+    uint32_t index = 0;
+    uint32_t generation = 0; // never 0 while alive, so component{} is null
+};
+
+/**
+ * Rects on screen that the mouse hovers, presses and focuses. Rects and
+ * flags are each one array in the order they were added, later ones on
+ * top, so the focus pass walks contiguous memory. Removing only marks
+ * one, the arrays are packed again once enough are, and slots are
+ * reused, so adding and removing are O(1) and take nothing from the
+ * heap once it's held as many as it will. Handles stay valid until the
+ * component is removed.
+ */
+class component_pool {
+public:
+    component_pool();
+    component add(int x, int y, int w, int h); // on top of the rest
+    void remove(component c);
+    bool alive(component c) const;
+    size_t size() const;
+    SDL_Rect *rect(component c); // nullptr once it's removed, move it or resize it through this
+    unsigned flags(component c) const; // component_flag, 0 once it's removed
+    void focus(ivec2 mouse, bool lclick); // once a frame
+private:
+    struct slot {
+        uint32_t generation;
+        int row; // -1 while the slot is free
+    };
+
+    std::vector<SDL_Rect> rects{}; // by row
+    std::vector<uint8_t> states{}; // by row, component_flag
+    std::vector<uint32_t> owners{}; // by row, the slot
+    std::vector<slot> slots{};
+    std::vector<uint32_t> free_slots{};
+    size_t removed = 0; // rows marked but not packed yet
 
-    int x = 0;
-    int y = 0;
-    int w = 0;
-    int h = 0;
-    bool mouse_hovering = false;
-    bool mouse_pressing = false;
-    bool mouse_pressed = false;
-    bool focused = false; // invisible
-    component();
-    component(int x, int y, int w, int h);
-    bool within(ivec2 coords);
-    void reset_focus();
+    void pack();
 };
 
 } // pse
@@ -22,6 +22,7 @@ context::context(const char* title, int w, int h, size_t fps)
     }
 
     set_frame_target(fps);
+    frames.make_current();
 }
 
 void context::set_window(const char *title, int w, int h, unsigned int flags)
@@ -51,6 +52,8 @@ void context::set_window(const char *title, int w, int h, unsigned int flags)
         fprintf(stderr, "Error: Failed to initialize SDL Renderer\n");
         exit(-1);
     }
+    // shapes with alpha below 255 are translucent
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
 }
 
 void context::run(void (*setup)(context& ctx), void (*update)(context& ctx), void (*cleanup)(context& ctx))
@@ -58,7 +61,7 @@ void context::run(void (*setup)(context& ctx), void (*update)(context& ctx), voi
     srand(time(0));
 
     auto time_now = []() {
-        return std::chrono::high_resolution_clock::now();
+        return std::chrono::steady_clock::now();
     };
     auto time_in_us = [](auto time) {
         return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
@@ -68,14 +71,16 @@ void context::run(void (*setup)(context& ctx), void (*update)(context& ctx), voi
     };
 
     double frame_time = 0.0;
-    auto frame_time_next = time_now();
-    auto frame_time_diff = time_now() - frame_time_next;
     bool scroll_happened = false;
 
     setup(*this);
+    auto frame_start = time_now();
 
     // program loop
     while (!done) {
+        // the loop's own thread always counts, see pse/alloc.hpp
+        alloc_zone frame_zone{"run"};
+        frames.reset();
         scroll_happened = false;
         // event loop
         while (SDL_PollEvent(&event)) {
@@ -133,55 +138,31 @@ void context::run(void (*setup)(context& ctx), void (*update)(context& ctx), voi
         keystate = (unsigned char*)SDL_GetKeyboardState(NULL);
 
         // component focus
-        int i;
-        for (i = 0; i < components.size(); i++) {
-            component *c = components[i];
-            if (c->focused) {
-                continue;
-            }
-
-            // determine focus
-            c->mouse_hovering = c->within(ivec2{mouse.x, mouse.y});
-            c->mouse_pressing = c->mouse_hovering && mouse.lclick;
-            // component started being pressed on / positive edge of click
-            if (c->mouse_pressing && !c->mouse_pressed) {
-                c->mouse_pressed = true;
-                c->focused = false;
-            }
-            // the mouse leaves the bounds
-            if (!c->mouse_hovering) {
-                c->mouse_pressed = false;
-            }
-            // negative edge of click
-            if (c->mouse_pressed && c->mouse_hovering && !mouse.lclick) {
-                c->mouse_pressed = false;
-                c->focused = true;
-            }
-        }
-
-        // reset focus on all panels beneath the top one
-        for (--i; i >= 0; i--) {
-            component *c = components[i];
-            if (c->focused) {
-                c->reset_focus();
-            }
-        }
+        components.focus(ivec2{mouse.x, mouse.y}, mouse.lclick);
 
         // drawing
         SDL_SetRenderDrawColor(renderer, Black.r, Black.g, Black.b, Black.a);
         SDL_RenderClear(renderer);
-        update(*this);
+        {
+            alloc_zone zone{"update"};
+            update(*this);
+        }
         SDL_RenderPresent(renderer);
 
-        // frame management
-        frame_time_diff = time_now() - frame_time_next;
-        frame_time_next = time_now();
-        frame_time = time_in_us(frame_time_diff);
+        // frame management, what's left goes to background work then sleep
+        {
+            alloc_zone zone{"background"};
+            background.run(frame_start + std::chrono::microseconds((long long)(frame_time_target - PSE_IDLE_MARGIN_US)));
+        }
+        frame_time = time_in_us(time_now() - frame_start);
         if (frame_time_target - frame_time > 0) {
             sleep_us(frame_time_target - frame_time);
         }
+        auto frame_end = time_now();
         frame_counter = (frame_counter + 1) % frame_target;
-        delta_time = frame_time / US_PER_S;
+        delta_time = time_in_us(frame_end - frame_start) / US_PER_S;
+        frame_start = frame_end;
+        alloc_frame_end();
     } // end program loop
 
     if (cleanup) {
@@ -193,9 +174,6 @@ void context::run(void (*setup)(context& ctx), void (*update)(context& ctx), voi
 
 context::~context()
 {
-    for (int i = 0; i < components.size(); i++) {
-        delete components[i];
-    }
     for (auto t: textures) {
         SDL_DestroyTexture(t);
     }
@@ -222,9 +200,14 @@ void context::quit()
     done = true;
 }
 
-void context::component_add(component *c)
+component context::component_add(int x, int y, int w, int h)
+{
+    return components.add(x, y, w, h);
+}
+
+void context::component_remove(component c)
 {
-    components.push_back(c);
+    components.remove(c);
 }
 
 void context::set_frame_target(size_t target)
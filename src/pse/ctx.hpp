@@ -3,7 +3,12 @@
 #include <time.h>
 #include <vector>
 
+#include "alloc.hpp"
+#include "arena.hpp"
 #include "component.hpp"
+#include "drawlist.hpp"
+#include "idle.hpp"
+#include "pool.hpp"
 #include "types.hpp"
 
 namespace pse {
@@ -20,6 +25,8 @@ namespace pse {
 #define PSE_RESOLUTION_169_1600_900 1600, 900
 #define PSE_RESOLUTION_169_1920_1080 1920, 1080
 
+constexpr double PSE_IDLE_MARGIN_US = 1000.0; // kept clear of background work at the end of a frame, sleeps wake late
+
 class context {
 private:
     // SDL bindings
@@ -28,7 +35,11 @@ private:
     SDL_Event event = {0};
 public:
     std::vector<SDL_Texture *> textures{};
-    std::vector<component *> components{};
+    std::vector<uint64_t> masks{}; // opaque coverage of each texture, see occlusion.hpp
+    component_pool components{};
+    frame_arenas frames{}; // per-frame scratch for each thread, emptied as each loop starts, outlives the workers
+    pool workers{}; // shared by anything that runs in parallel
+    idle background{}; // low priority work, given what's left of each frame before sleeping
     
     // Input Devices
     struct {
@@ -64,13 +75,17 @@ public:
     bool check_key_invalidate(int sdl_scancode);
     void quit();
 
-    void component_add(component *c);
+    component component_add(int x, int y, int w, int h); // on top of those added before
+    void component_remove(component c);
 
     int load_image(const char *path); // put an image into textures, return its ID
+    uint64_t image_mask(int id); // get the opaque coverage mask of an image
     void draw_image(int id, SDL_Rect rect); // draw an image to coordinates
+    void draw_list(drawlist& list); // draw the visible images of a sorted list
     void draw_clear(SDL_Color c); // clear entire surface
     void draw_rect(SDL_Color c, SDL_Rect rect); // draw rectangle outline
     void draw_rect_fill(SDL_Color c, SDL_Rect rect); // draw filled rectangle
+    void draw_rects_fill(SDL_Color c, const SDL_Rect *rects, int count); // draw many filled rectangles at once
     void draw_circle(SDL_Color c, int x, int y, int radius); // draw circle outline
     void draw_circle_fill(SDL_Color c, int x, int y, int radius); // draw filled circle
     void draw_line(SDL_Color c, int x1, int y1, int x2, int y2); // draw a line
@@ -5,22 +5,68 @@
 
 namespace pse {
 
+/**
+ * Find which cells of the image are fully opaque, the image
+ * is split into PSE_MASK_CELLS x PSE_MASK_CELLS cells
+ */
+static uint64_t surface_opaque_mask(SDL_Surface *s)
+{
+    SDL_Surface *rgba = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_RGBA32, 0);
+    if (!rgba) {
+        return 0;
+    }
+
+    uint64_t mask = ~0ULL;
+    SDL_LockSurface(rgba);
+    for (int y = 0; y < rgba->h; y++) {
+        const Uint8 *row = (const Uint8 *)rgba->pixels + y * rgba->pitch;
+        int i = y * PSE_MASK_CELLS / rgba->h;
+        for (int x = 0; x < rgba->w; x++) {
+            // RGBA32 is byte ordered, alpha is always the 4th byte
+            if (row[x * 4 + 3] != 255) {
+                int j = x * PSE_MASK_CELLS / rgba->w;
+                mask &= ~(1ULL << (i * PSE_MASK_CELLS + j));
+            }
+        }
+    }
+    SDL_UnlockSurface(rgba);
+    SDL_FreeSurface(rgba);
+    return mask;
+}
+
 int context::load_image(const char *path)
 {
-    SDL_Texture *t = IMG_LoadTexture(renderer, path);
+    SDL_Surface *s = IMG_Load(path);
+    SDL_Texture *t = s ? SDL_CreateTextureFromSurface(renderer, s) : nullptr;
     if (!t) {
         fprintf(stderr, "Error: Invalid texture/path: '%s'\n", path);
         exit(-1);
     }
     textures.push_back(t);
+    masks.push_back(surface_opaque_mask(s));
+    SDL_FreeSurface(s);
     return (int)textures.size() - 1;
 }
 
+uint64_t context::image_mask(int id)
+{
+    return masks[id];
+}
+
 void context::draw_image(int id, SDL_Rect rect)
 {
     SDL_RenderCopy(renderer, textures[id], NULL, &rect);
 }
 
+void context::draw_list(drawlist& list)
+{
+    for (draw_item& it : list.items) {
+        if (it.visible) {
+            SDL_RenderCopy(renderer, textures[it.id], NULL, &it.rect);
+        }
+    }
+}
+
 void context::draw_clear(SDL_Color c)
 {
     SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
@@ -39,6 +85,12 @@ void context::draw_rect_fill(SDL_Color c, SDL_Rect rect)
     SDL_RenderFillRect(renderer, &rect);
 }
 
+void context::draw_rects_fill(SDL_Color c, const SDL_Rect *rects, int count)
+{
+    SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+    SDL_RenderFillRects(renderer, rects, count);
+}
+
 void context::draw_circle(SDL_Color c, int x, int y, int radius)
 {
     SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <climits>
+
+#include "drawlist.hpp"
+
+namespace pse {
+
+drawlist::drawlist()
+{
+
+}
+
+drawlist::drawlist(int layers)
+: layers{layers}
+{
+
+}
+
+void drawlist::clear()
+{
+    items.clear();
+}
+
+void drawlist::push(int layer, int depth, int id, SDL_Rect rect, uint64_t opaque)
+{
+    items.push_back(draw_item{ layer, depth, id, rect, opaque, true });
+}
+
+void drawlist::sort()
+{
+    if (items.size() < 2) {
+        return;
+    }
+
+    int lo = INT_MAX;
+    int hi = INT_MIN;
+    for (draw_item& it : items) {
+        lo = std::min(lo, it.depth);
+        hi = std::max(hi, it.depth);
+    }
+
+    // one bucket per layer and depth, prefix sum into positions
+    const int range = hi - lo + 1;
+    counts.assign(layers * range + 1, 0);
+    for (draw_item& it : items) {
+        counts[it.layer * range + it.depth - lo + 1]++;
+    }
+    for (size_t i = 1; i < counts.size(); i++) {
+        counts[i] += counts[i - 1];
+    }
+
+    sorted.resize(items.size());
+    for (draw_item& it : items) {
+        sorted[counts[it.layer * range + it.depth - lo]++] = it;
+    }
+    items.swap(sorted);
+}
+
+void drawlist::cull(occlusion& occ)
+{
+    occ.clear();
+    for (int i = (int)items.size() - 1; i >= 0; i--) {
+        draw_item& it = items[i];
+        if (occ.occluded(it.rect)) {
+            it.visible = false;
+            continue;
+        }
+        occ.cover(it.rect, it.opaque);
+    }
+}
+
+} // pse
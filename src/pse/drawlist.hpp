@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "occlusion.hpp"
+#include "types.hpp"
+
+namespace pse {
+
+struct draw_item {
+    int layer; // drawn in increasing layer, then increasing depth
+    int depth;
+    int id; // texture id
+    SDL_Rect rect;
+    uint64_t opaque; // opaque coverage of the texture, 0 never occludes
+    bool visible;
+};
+
+/**
+ * Images to draw this frame, keyed by layer and depth. Sorting is a
+ * stable counting sort over the range of depths pushed, so it is O(n)
+ * as long as depths are kept to the visible region.
+ */
+struct drawlist {
+    std::vector<draw_item> items{};
+    int layers = 1;
+
+    drawlist();
+    drawlist(int layers);
+    void clear();
+    void push(int layer, int depth, int id, SDL_Rect rect, uint64_t opaque);
+    void sort();
+    void cull(occlusion& occ); // hide items entirely behind opaque items in front of them
+private:
+    std::vector<draw_item> sorted{};
+    std::vector<int> counts{};
+};
+
+} // pse
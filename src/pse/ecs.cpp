@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#include "ecs.hpp"
+
+namespace pse {
+
+static std::mutex type_lock;
+static std::vector<size_t> type_sizes;
+
+int registry::type_register(size_t size)
+{
+    std::lock_guard<std::mutex> guard(type_lock);
+    // archetype masks are 64 bit and column_of is fixed size
+    if (type_sizes.size() >= PSE_MAX_COMPONENTS) {
+        fprintf(stderr, "Error: More than %d component types registered\n", PSE_MAX_COMPONENTS);
+        abort();
+    }
+    type_sizes.push_back(size);
+    return (int)type_sizes.size() - 1;
+}
+
+size_t registry::type_size(int type)
+{
+    std::lock_guard<std::mutex> guard(type_lock);
+    return type_sizes[type];
+}
+
+registry::registry()
+{
+    archetype_get(0);
+}
+
+entity registry::create()
+{
+    uint32_t index;
+    if (!free_slots.empty()) {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+    else {
+        index = (uint32_t)slots.size();
+        slots.push_back(slot{ 1, 0, 0 });
+    }
+
+    entity e{ index, slots[index].generation };
+    archetype& empty = archetypes[0];
+    slots[index].archetype = 0;
+    slots[index].row = (int)empty.entities.size();
+    empty.entities.push_back(e);
+    live++;
+    return e;
+}
+
+void registry::destroy(entity e)
+{
+    if (!alive(e)) {
+        return;
+    }
+    slot& s = slots[e.index];
+    row_remove(s.archetype, s.row);
+    s.archetype = -1;
+    if (++s.generation == 0) {
+        s.generation = 1;
+    }
+    free_slots.push_back(e.index);
+    live--;
+}
+
+bool registry::alive(entity e) const
+{
+    return e.index < slots.size() && e.generation != 0 && slots[e.index].generation == e.generation;
+}
+
+entity registry::at(uint32_t index) const
+{
+    if (index >= slots.size() || slots[index].archetype == -1) {
+        return entity{};
+    }
+    return entity{ index, slots[index].generation };
+}
+
+size_t registry::count() const
+{
+    return live;
+}
+
+int registry::archetype_get(uint64_t mask)
+{
+    auto it = archetype_of_mask.find(mask);
+    if (it != archetype_of_mask.end()) {
+        return it->second;
+    }
+
+    archetype a;
+    a.mask = mask;
+    for (int t = 0; t < PSE_MAX_COMPONENTS; t++) {
+        a.column_of[t] = -1;
+        if (mask & (1ULL << t)) {
+            a.column_of[t] = (int)a.columns.size();
+            a.columns.push_back(column{ type_size(t), {} });
+        }
+    }
+    archetypes.push_back(std::move(a));
+    archetype_of_mask[mask] = (int)archetypes.size() - 1;
+    return (int)archetypes.size() - 1;
+}
+
+/**
+ * The last row fills the hole so the arrays stay packed
+ */
+void registry::row_remove(int a, int row)
+{
+    archetype& arch = archetypes[a];
+    const int last = (int)arch.entities.size() - 1;
+    for (column& c : arch.columns) {
+        if (row != last) {
+            std::memcpy(&c.data[row * c.size], &c.data[last * c.size], c.size);
+        }
+        c.data.resize(last * c.size);
+    }
+    if (row != last) {
+        arch.entities[row] = arch.entities[last];
+        slots[arch.entities[row].index].row = row;
+    }
+    arch.entities.pop_back();
+}
+
+void registry::move(entity e, uint64_t mask)
+{
+    const int to = archetype_get(mask);
+    slot& s = slots[e.index];
+    archetype& src = archetypes[s.archetype];
+    archetype& dst = archetypes[to];
+
+    const int row = (int)dst.entities.size();
+    for (int t = 0; t < PSE_MAX_COMPONENTS; t++) {
+        if (dst.column_of[t] == -1) {
+            continue;
+        }
+        column& c = dst.columns[dst.column_of[t]];
+        c.data.resize((row + 1) * c.size);
+        if (src.column_of[t] != -1) {
+            std::memcpy(&c.data[row * c.size], &src.columns[src.column_of[t]].data[s.row * c.size], c.size);
+        }
+        else {
+            std::memset(&c.data[row * c.size], 0, c.size);
+        }
+    }
+    dst.entities.push_back(e);
+
+    row_remove(s.archetype, s.row);
+    s.archetype = to;
+    s.row = row;
+}
+
+void *registry::component(entity e, int type)
+{
+    const slot& s = slots[e.index];
+    archetype& a = archetypes[s.archetype];
+    column& c = a.columns[a.column_of[type]];
+    return &c.data[s.row * c.size];
+}
+
+} // pse
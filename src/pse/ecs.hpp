@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "pool.hpp"
+
+namespace pse {
+
+// component types one program can use, each is one bit of an archetype
+#define PSE_MAX_COMPONENTS 64
+
+// rows a worker takes at once in a parallel each
+#define PSE_EACH_BLOCK 4096
+
+struct entity {
+    uint32_t index = 0;
+    uint32_t generation = 0; // never 0 while alive, so entity{} is null
+};
+
+/**
+ * Entities and their components. Every combination of component types
+ * is an archetype, and an archetype keeps each type in its own array
+ * with the rows lined up, so systems walk contiguous memory.
+ *
+ * Components are plain data, moved around with memcpy. Handles stay
+ * valid until the entity is destroyed, rows don't.
+ */
+class registry {
+public:
+    registry();
+    entity create();
+    void destroy(entity e);
+    bool alive(entity e) const;
+    entity at(uint32_t index) const; // the live entity with that index, or null
+    size_t count() const;
+
+    template <typename T> void add(entity e, const T& value); // replaces it if there is one
+    template <typename T> void remove(entity e);
+    template <typename T> T *get(entity e); // nullptr without one
+    template <typename T> bool has(entity e) const;
+
+    // fn(entity, Ts&...) for every entity with all of Ts, fn can't create, destroy, add or remove
+    template <typename... Ts, typename F> void each(F fn);
+    template <typename... Ts, typename F> void each(pool& workers, F fn); // split across the workers
+private:
+    struct column {
+        size_t size; // bytes per component
+        std::vector<uint8_t> data;
+    };
+    struct archetype {
+        uint64_t mask;
+        int column_of[PSE_MAX_COMPONENTS]; // -1 for types it doesn't have
+        std::vector<column> columns;
+        std::vector<entity> entities; // by row
+    };
+    struct slot {
+        uint32_t generation;
+        int archetype; // -1 while the slot is free
+        int row;
+    };
+
+    std::vector<slot> slots{};
+    std::vector<uint32_t> free_slots{};
+    std::vector<archetype> archetypes{};
+    std::unordered_map<uint64_t, int> archetype_of_mask{};
+    size_t live = 0;
+
+    static int type_register(size_t size);
+    static size_t type_size(int type);
+    template <typename T> static int type_id();
+
+    int archetype_get(uint64_t mask);
+    void row_remove(int a, int row);
+    void move(entity e, uint64_t mask); // to the archetype of mask, keeping the components both have
+    void *component(entity e, int type);
+    template <typename T> static T *column_data(archetype& a);
+    template <typename... Ts, typename F> static void each_rows(archetype& a, size_t begin, size_t end, F& fn);
+};
+
+template <typename T>
+int registry::type_id()
+{
+    static_assert(std::is_trivially_copyable<T>::value, "components are moved with memcpy");
+    static const int id = type_register(sizeof(T));
+    return id;
+}
+
+template <typename T>
+void registry::add(entity e, const T& value)
+{
+    if (!alive(e)) {
+        return;
+    }
+    const int type = type_id<T>();
+    if (!(archetypes[slots[e.index].archetype].mask & (1ULL << type))) {
+        move(e, archetypes[slots[e.index].archetype].mask | (1ULL << type));
+    }
+    std::memcpy(component(e, type), &value, sizeof(T));
+}
+
+template <typename T>
+void registry::remove(entity e)
+{
+    if (!has<T>(e)) {
+        return;
+    }
+    move(e, archetypes[slots[e.index].archetype].mask & ~(1ULL << type_id<T>()));
+}
+
+template <typename T>
+T *registry::get(entity e)
+{
+    return has<T>(e) ? (T *)component(e, type_id<T>()) : nullptr;
+}
+
+template <typename T>
+bool registry::has(entity e) const
+{
+    return alive(e) && (archetypes[slots[e.index].archetype].mask & (1ULL << type_id<T>()));
+}
+
+template <typename T>
+T *registry::column_data(archetype& a)
+{
+    return (T *)a.columns[a.column_of[type_id<T>()]].data.data();
+}
+
+template <typename... Ts, typename F>
+void registry::each_rows(archetype& a, size_t begin, size_t end, F& fn)
+{
+    std::tuple<Ts *...> cols{ column_data<Ts>(a)... };
+    const entity *entities = a.entities.data();
+    for (size_t i = begin; i < end; i++) {
+        std::apply([&](Ts *... c) { fn(entities[i], c[i]...); }, cols);
+    }
+}
+
+template <typename... Ts, typename F>
+void registry::each(F fn)
+{
+    const uint64_t want = (0ULL | ... | (1ULL << type_id<Ts>()));
+    for (size_t k = 0; k < archetypes.size(); k++) {
+        archetype& a = archetypes[k];
+        if ((a.mask & want) == want && !a.entities.empty()) {
+            each_rows<Ts...>(a, 0, a.entities.size(), fn);
+        }
+    }
+}
+
+template <typename... Ts, typename F>
+void registry::each(pool& workers, F fn)
+{
+    const uint64_t want = (0ULL | ... | (1ULL << type_id<Ts>()));
+    struct block {
+        archetype *a;
+        size_t begin;
+        size_t end;
+    };
+    frame_vector<block> blocks;
+    for (archetype& a : archetypes) {
+        if ((a.mask & want) != want) {
+            continue;
+        }
+        for (size_t i = 0; i < a.entities.size(); i += PSE_EACH_BLOCK) {
+            blocks.push_back(block{ &a, i, std::min(i + PSE_EACH_BLOCK, a.entities.size()) });
+        }
+    }
+    workers.parallel_for((int)blocks.size(), [&blocks, &fn](int i) {
+        each_rows<Ts...>(*blocks[i].a, blocks[i].begin, blocks[i].end, fn);
+    });
+}
+
+} // pse
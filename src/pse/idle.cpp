@@ -0,0 +1,58 @@
+#include <algorithm>
+
+#include "idle.hpp"
+
+namespace pse {
+
+idle::idle()
+{
+
+}
+
+int idle::add(std::function<bool()> step)
+{
+    jobs.push_back(idle_job{next_id, step, 0.0, false});
+    return next_id++;
+}
+
+void idle::remove(int id)
+{
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [id](const idle_job& j) { return j.id == id; }), jobs.end());
+}
+
+void idle::run(idle_deadline deadline)
+{
+    for (idle_job& j : jobs) {
+        j.resting = false;
+    }
+    int resting = 0;
+    while (resting < (int)jobs.size()) {
+        turn = turn % jobs.size();
+        idle_job& j = jobs[turn];
+        turn++;
+        if (j.resting) {
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        double left = std::chrono::duration<double, std::micro>(deadline - start).count();
+        if (left <= 0.0) {
+            return;
+        }
+        if (j.cost_us > left) {
+            // or one slow step would keep it out for good
+            j.cost_us *= 0.9;
+            j.resting = true;
+            resting++;
+            continue;
+        }
+        bool more = j.step();
+        double took = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        j.cost_us = std::max(took, j.cost_us * 0.9 + took * 0.1);
+        if (!more) {
+            j.resting = true;
+            resting++;
+        }
+    }
+}
+
+} // pse
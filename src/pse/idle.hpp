@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace pse {
+
+typedef std::chrono::steady_clock::time_point idle_deadline;
+
+struct idle_job {
+    int id;
+    std::function<bool()> step; // false once there's nothing left for it to do this frame
+    double cost_us; // how long a step has been taking, leans to the slow ones
+    bool resting; // nothing to do or no room for it, until the next run
+};
+
+/**
+ * Low priority work done in whatever is left of a frame. Each job is
+ * something incremental broken into short steps, run in turn on the
+ * calling thread until the deadline. Nothing can be stopped halfway, so
+ * a step is only started if it took no longer before than what's left.
+ */
+class idle {
+public:
+    idle();
+    int add(std::function<bool()> step); // runs from the next frame on, until removed
+    void remove(int id); // not from inside a step, nor is add
+    void run(idle_deadline deadline); // returns once every job is resting or there is no time left
+private:
+    std::vector<idle_job> jobs{};
+    int next_id = 0;
+    size_t turn = 0; // job that gets the first step, so every job gets time
+};
+
+} // pse
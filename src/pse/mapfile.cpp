@@ -0,0 +1,121 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapfile.hpp"
+
+namespace pse {
+
+mapfile::mapfile()
+{
+
+}
+
+mapfile::~mapfile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool mapfile::open(const char *path)
+{
+    close();
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER n;
+    if (!GetFileSizeEx(f, &n) || n.QuadPart == 0) {
+        CloseHandle(f);
+        return false;
+    }
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) {
+        CloseHandle(f);
+        return false;
+    }
+    void *view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    mapping = m;
+    bytes = (const uint8_t *)view;
+    length = (size_t)n.QuadPart;
+    return true;
+}
+
+void mapfile::close()
+{
+    if (bytes) {
+        UnmapViewOfFile(bytes);
+        CloseHandle((HANDLE)mapping);
+        CloseHandle((HANDLE)file);
+    }
+    bytes = nullptr;
+    length = 0;
+    file = nullptr;
+    mapping = nullptr;
+}
+
+#else
+
+bool mapfile::open(const char *path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    // the mapping keeps the file alive once it's made
+    void *view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    bytes = (const uint8_t *)view;
+    length = (size_t)st.st_size;
+    return true;
+}
+
+void mapfile::close()
+{
+    if (bytes) {
+        munmap((void *)bytes, length);
+    }
+    bytes = nullptr;
+    length = 0;
+}
+
+#endif
+
+bool mapfile::is_open() const
+{
+    return bytes != nullptr;
+}
+
+const uint8_t *mapfile::data() const
+{
+    return bytes;
+}
+
+size_t mapfile::size() const
+{
+    return length;
+}
+
+} // pse
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pse {
+
+/**
+ * A whole file mapped read only into memory, pages are
+ * read in by the OS when they are first touched
+ */
+class mapfile {
+public:
+    mapfile();
+    ~mapfile();
+    mapfile(const mapfile&) = delete;
+    mapfile& operator=(const mapfile&) = delete;
+    bool open(const char *path); // false if it can't be read or is empty
+    void close();
+    bool is_open() const;
+    const uint8_t *data() const;
+    size_t size() const;
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr; // HANDLE
+    void *mapping = nullptr;
+#endif
+};
+
+} // pse
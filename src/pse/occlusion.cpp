@@ -0,0 +1,110 @@
+#include <algorithm>
+
+#include "occlusion.hpp"
+
+namespace pse {
+
+occlusion::occlusion()
+{
+
+}
+
+occlusion::occlusion(int screen_w, int screen_h, int block)
+{
+    resize(screen_w, screen_h, block);
+}
+
+void occlusion::resize(int screen_w, int screen_h, int block)
+{
+    this->block = block;
+    blocks_w = (screen_w + block - 1) / block;
+    blocks_h = (screen_h + block - 1) / block;
+    words_per_row = (blocks_w + 63) / 64;
+    bits.assign(words_per_row * blocks_h, 0);
+}
+
+void occlusion::clear()
+{
+    std::fill(bits.begin(), bits.end(), 0);
+}
+
+/**
+ * Mask of bits [first, last] in word w of a row, both are block columns
+ */
+static inline uint64_t row_word_mask(int w, int first, int last)
+{
+    int lo = std::max(first - w * 64, 0);
+    int hi = std::min(last - w * 64, 63);
+    uint64_t upper = (hi == 63) ? ~0ULL : ((1ULL << (hi + 1)) - 1);
+    return upper & ~((1ULL << lo) - 1);
+}
+
+bool occlusion::occluded(const SDL_Rect& rect) const
+{
+    int x0 = std::max(rect.x, 0);
+    int y0 = std::max(rect.y, 0);
+    int x1 = std::min(rect.x + rect.w, blocks_w * block);
+    int y1 = std::min(rect.y + rect.h, blocks_h * block);
+
+    // nothing of it is on the screen
+    if (x0 >= x1 || y0 >= y1) {
+        return true;
+    }
+
+    int bx0 = x0 / block;
+    int bx1 = (x1 - 1) / block;
+    int by0 = y0 / block;
+    int by1 = (y1 - 1) / block;
+
+    for (int by = by0; by <= by1; by++) {
+        const uint64_t *row = &bits[by * words_per_row];
+        for (int w = bx0 / 64; w <= bx1 / 64; w++) {
+            uint64_t m = row_word_mask(w, bx0, bx1);
+            if ((row[w] & m) != m) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void occlusion::cover(const SDL_Rect& rect, uint64_t mask)
+{
+    if (mask == 0 || rect.w <= 0 || rect.h <= 0) {
+        return;
+    }
+
+    // only blocks entirely inside of the rect can be covered
+    // (division truncates towards 0, which rounds negatives up already)
+    int bx0 = std::max(rect.x > 0 ? (rect.x + block - 1) / block : rect.x / block, 0);
+    int by0 = std::max(rect.y > 0 ? (rect.y + block - 1) / block : rect.y / block, 0);
+    int bx1 = std::min((rect.x + rect.w) / block, blocks_w); // exclusive
+    int by1 = std::min((rect.y + rect.h) / block, blocks_h);
+
+    for (int by = by0; by < by1; by++) {
+        // mask rows the block overlaps, padded by a pixel for scaling error
+        int py0 = std::max(by * block - 1, rect.y);
+        int py1 = std::min((by + 1) * block, rect.y + rect.h - 1);
+        int i0 = (py0 - rect.y) * PSE_MASK_CELLS / rect.h;
+        int i1 = (py1 - rect.y) * PSE_MASK_CELLS / rect.h;
+        uint64_t *row = &bits[by * words_per_row];
+
+        for (int bx = bx0; bx < bx1; bx++) {
+            int px0 = std::max(bx * block - 1, rect.x);
+            int px1 = std::min((bx + 1) * block, rect.x + rect.w - 1);
+            int j0 = (px0 - rect.x) * PSE_MASK_CELLS / rect.w;
+            int j1 = (px1 - rect.x) * PSE_MASK_CELLS / rect.w;
+            uint64_t cols = ((1ULL << (j1 + 1)) - 1) & ~((1ULL << j0) - 1);
+
+            bool opaque = true;
+            for (int i = i0; i <= i1 && opaque; i++) {
+                opaque = ((mask >> (i * PSE_MASK_CELLS)) & cols) == cols;
+            }
+            if (opaque) {
+                row[bx / 64] |= 1ULL << (bx % 64);
+            }
+        }
+    }
+}
+
+} // pse
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+
+namespace pse {
+
+// Images are split into an 8x8 grid of cells, bit (row * 8 + col) is set
+// when every pixel in that cell is fully opaque
+#define PSE_MASK_CELLS 8
+
+/**
+ * Screen space coverage buffer with one bit per block of pixels.
+ * Walk sprites front to back, skip the ones that are already
+ * occluded, then cover the blocks the sprite is opaque over.
+ */
+struct occlusion {
+    int block = 16; // pixels per side of a block
+    int blocks_w = 0;
+    int blocks_h = 0;
+    int words_per_row = 0;
+    std::vector<uint64_t> bits{};
+
+    occlusion();
+    occlusion(int screen_w, int screen_h, int block);
+    void resize(int screen_w, int screen_h, int block);
+    void clear();
+    bool occluded(const SDL_Rect& rect) const; // is every block the rect touches covered
+    void cover(const SDL_Rect& rect, uint64_t mask); // cover blocks entirely within opaque mask cells
+};
+
+} // pse
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "alloc.hpp"
+#include "pool.hpp"
+
+namespace pse {
+
+pool::pool()
+{
+    start(std::max((int)std::thread::hardware_concurrency() - 1, 0));
+}
+
+pool::pool(int workers)
+{
+    start(workers);
+}
+
+pool::~pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void pool::start(int workers)
+{
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back(&pool::work, this);
+    }
+}
+
+int pool::size() const
+{
+    return (int)threads.size() + 1;
+}
+
+void pool::work()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this]() { return stopping || first < jobs.size(); });
+            if (first == jobs.size()) {
+                return;
+            }
+            job = std::move(jobs[first]);
+            if (++first == jobs.size()) {
+                jobs.clear();
+                first = 0;
+            }
+        }
+        job();
+    }
+}
+
+void pool::submit(std::function<void()> job)
+{
+    if (threads.empty()) {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+pool::batch *pool::batch_get(const std::function<void(int)> *fn)
+{
+    std::lock_guard<std::mutex> guard(batches_lock);
+    batch *b = nullptr;
+    for (auto& k : batches) {
+        if (k->helpers.load() == 0 && k->fn == nullptr) {
+            b = k.get();
+            break;
+        }
+    }
+    if (!b) {
+        batches.emplace_back(new batch{});
+        b = batches.back().get();
+    }
+    b->fn = fn;
+    return b;
+}
+
+void pool::batch_run(batch& b)
+{
+    alloc_zone zone{b.zone};
+    int i;
+    while ((i = b.next.fetch_add(1)) < b.count) {
+        (*b.fn)(i);
+        if (b.done.fetch_add(1) + 1 == b.count) {
+            std::lock_guard<std::mutex> guard(b.lock);
+            b.finished.notify_all();
+        }
+    }
+}
+
+void pool::parallel_for(int count, const std::function<void(int)>& fn)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    // fn is only called while there are indices left, so late helpers never touch it
+    batch *b = batch_get(&fn);
+    b->zone = alloc_zone_name();
+    b->count = count;
+    b->next = 0;
+    b->done = 0;
+
+    int helpers = std::min((int)threads.size(), count - 1);
+    b->helpers = helpers;
+    for (int i = 0; i < helpers; i++) {
+        submit([b]() {
+            batch_run(*b);
+            b->helpers.fetch_sub(1);
+        });
+    }
+    batch_run(*b);
+
+    {
+        std::unique_lock<std::mutex> guard(b->lock);
+        b->finished.wait(guard, [&]() { return b->done.load() == count; });
+    }
+    std::lock_guard<std::mutex> guard(batches_lock);
+    b->fn = nullptr;
+}
+
+} // pse
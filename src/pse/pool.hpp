@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pse {
+
+/**
+ * Fixed set of worker threads. The thread calling parallel_for
+ * works on it too, so a pool without workers runs everything inline.
+ * Once it has handled as much at once as it's going to, handing out
+ * work takes nothing from the heap.
+ */
+class pool {
+public:
+    pool(); // one worker per hardware thread beyond the first
+    pool(int workers);
+    ~pool();
+    int size() const; // workers plus the calling thread
+    void submit(std::function<void()> job); // run on a worker, or inline without any
+    void parallel_for(int count, const std::function<void(int)>& fn); // fn(0..count-1), returns when all are done
+private:
+    /* Helpers may only get to their job after every index is done,
+       so a batch is kept until the last of them has let go of it. */
+    struct batch {
+        const std::function<void(int)> *fn;
+        const char *zone; // of the caller, helpers work in it too
+        int count;
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        std::atomic<int> helpers{0}; // still to let go of it
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+
+    std::vector<std::thread> threads{};
+    std::vector<std::function<void()>> jobs{}; // queued from first on, emptied once it's all taken
+    size_t first = 0;
+    std::mutex lock{};
+    std::condition_variable wake{};
+    bool stopping = false;
+    std::vector<std::unique_ptr<batch>> batches{};
+    std::mutex batches_lock{};
+    void start(int workers);
+    void work();
+    batch *batch_get(const std::function<void(int)> *fn); // one no helper still holds, set to run fn
+    static void batch_run(batch& b);
+};
+
+} // pse
@@ -1,5 +1,13 @@
 #pragma once
 
+#include "alloc.hpp"
+#include "arena.hpp"
+#include "bitgrid.hpp"
 #include "ctx.hpp"
 #include "colors.hpp"
+#include "ecs.hpp"
+#include "idle.hpp"
+#include "mapfile.hpp"
+#include "spatial.hpp"
+#include "sumgrid.hpp"
 #include "util.hpp"
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+#include "spatial.hpp"
+
+namespace pse {
+
+spatial_hash::spatial_hash()
+{
+
+}
+
+spatial_hash::spatial_hash(float width, float height, float cell)
+{
+    resize(width, height, cell);
+}
+
+void spatial_hash::resize(float width, float height, float cell)
+{
+    cell_size = cell;
+    inv_cell = 1.0f / cell;
+    cols = std::max((int)std::ceil(width * inv_cell), 1);
+    rows = std::max((int)std::ceil(height * inv_cell), 1);
+    cells.assign(cols * rows, std::vector<spatial_item>{});
+    places.clear();
+    count = 0;
+}
+
+int spatial_hash::col_of(float x) const
+{
+    return std::min(std::max((int)std::floor(x * inv_cell), 0), cols - 1);
+}
+
+int spatial_hash::row_of(float y) const
+{
+    return std::min(std::max((int)std::floor(y * inv_cell), 0), rows - 1);
+}
+
+bool spatial_hash::contains(uint32_t id) const
+{
+    return id < places.size() && places[id].cell != -1;
+}
+
+size_t spatial_hash::size() const
+{
+    return count;
+}
+
+void spatial_hash::insert(uint32_t id, float x, float y)
+{
+    if (contains(id)) {
+        move(id, x, y);
+        return;
+    }
+    if (id >= places.size()) {
+        places.resize(id + 1, place{ -1, 0 });
+    }
+    int c = row_of(y) * cols + col_of(x);
+    places[id] = place{ c, (int)cells[c].size() };
+    cells[c].push_back(spatial_item{ id, x, y });
+    count++;
+}
+
+void spatial_hash::erase(uint32_t id)
+{
+    if (!contains(id)) {
+        return;
+    }
+    place& p = places[id];
+    std::vector<spatial_item>& bucket = cells[p.cell];
+    bucket[p.slot] = bucket.back();
+    places[bucket[p.slot].id].slot = p.slot;
+    bucket.pop_back();
+    p.cell = -1;
+    count--;
+}
+
+void spatial_hash::move(uint32_t id, float x, float y)
+{
+    if (!contains(id)) {
+        return;
+    }
+    place& p = places[id];
+    int c = row_of(y) * cols + col_of(x);
+    if (c == p.cell) {
+        cells[c][p.slot].x = x;
+        cells[c][p.slot].y = y;
+        return;
+    }
+    erase(id);
+    insert(id, x, y);
+}
+
+void spatial_hash::query_radius(float x, float y, float r, std::vector<uint32_t>& out) const
+{
+    const float r2 = r * r;
+    for (int cy = row_of(y - r); cy <= row_of(y + r); cy++) {
+        for (int cx = col_of(x - r); cx <= col_of(x + r); cx++) {
+            for (const spatial_item& it : cells[cy * cols + cx]) {
+                float dx = it.x - x;
+                float dy = it.y - y;
+                if (dx * dx + dy * dy <= r2) {
+                    out.push_back(it.id);
+                }
+            }
+        }
+    }
+}
+
+void spatial_hash::query_rect(float x, float y, float w, float h, std::vector<uint32_t>& out) const
+{
+    for (int cy = row_of(y); cy <= row_of(y + h); cy++) {
+        for (int cx = col_of(x); cx <= col_of(x + w); cx++) {
+            for (const spatial_item& it : cells[cy * cols + cx]) {
+                if (it.x >= x && it.x < x + w && it.y >= y && it.y < y + h) {
+                    out.push_back(it.id);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Visits square rings of cells around the point, keeping the best k so
+ * far, and stops once nothing outside of the rings seen can be closer
+ */
+void spatial_hash::query_nearest(float x, float y, int k, std::vector<uint32_t>& out) const
+{
+    if (k <= 0 || count == 0) {
+        return;
+    }
+
+    typedef std::pair<float, uint32_t> entry; // squared distance, id
+    std::priority_queue<entry> best; // farthest on top
+    auto visit = [&](int cx, int cy) {
+        if (cx < 0 || cx >= cols || cy < 0 || cy >= rows) {
+            return;
+        }
+        for (const spatial_item& it : cells[cy * cols + cx]) {
+            float dx = it.x - x;
+            float dy = it.y - y;
+            float d2 = dx * dx + dy * dy;
+            if ((int)best.size() < k) {
+                best.push(entry{ d2, it.id });
+            }
+            else if (d2 < best.top().first) {
+                best.pop();
+                best.push(entry{ d2, it.id });
+            }
+        }
+    };
+
+    const int cx = col_of(x);
+    const int cy = row_of(y);
+    const int last = std::max({ cx, cols - 1 - cx, cy, rows - 1 - cy });
+    for (int r = 0; r <= last; r++) {
+        if (r == 0) {
+            visit(cx, cy);
+        }
+        else {
+            for (int d = -r; d <= r; d++) {
+                visit(cx + d, cy - r);
+                visit(cx + d, cy + r);
+            }
+            for (int d = -r + 1; d <= r - 1; d++) {
+                visit(cx - r, cy + d);
+                visit(cx + r, cy + d);
+            }
+        }
+
+        // closest anything outside of the rings so far could be
+        float reach = std::min({
+            x - (cx - r) * cell_size, (cx + r + 1) * cell_size - x,
+            y - (cy - r) * cell_size, (cy + r + 1) * cell_size - y
+        });
+        if ((int)best.size() == k && reach > 0 && reach * reach >= best.top().first) {
+            break;
+        }
+    }
+
+    size_t first = out.size();
+    out.resize(first + best.size());
+    for (size_t i = out.size(); i > first; i--) {
+        out[i - 1] = best.top().second;
+        best.pop();
+    }
+}
+
+} // pse
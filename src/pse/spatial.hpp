@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace pse {
+
+struct spatial_item {
+    uint32_t id;
+    float x;
+    float y;
+};
+
+/**
+ * Uniform grid of buckets over a width x height area, for finding
+ * what is near a point. Buckets hold the positions themselves so
+ * queries never leave them, and moving within a cell only writes
+ * the new position. Ids index an array, keep them small and dense.
+ *
+ * Points outside of the area are kept in the edge buckets.
+ */
+class spatial_hash {
+public:
+    spatial_hash();
+    spatial_hash(float width, float height, float cell);
+    void resize(float width, float height, float cell); // removes everything
+    void insert(uint32_t id, float x, float y); // moves it if it's already in
+    void move(uint32_t id, float x, float y);
+    void erase(uint32_t id);
+    bool contains(uint32_t id) const;
+    size_t size() const;
+
+    // results are appended to out
+    void query_radius(float x, float y, float r, std::vector<uint32_t>& out) const;
+    void query_rect(float x, float y, float w, float h, std::vector<uint32_t>& out) const;
+    void query_nearest(float x, float y, int k, std::vector<uint32_t>& out) const; // closest first
+private:
+    struct place {
+        int cell; // -1 when it isn't in
+        int slot;
+    };
+
+    float cell_size = 1.0f;
+    float inv_cell = 1.0f;
+    int cols = 0;
+    int rows = 0;
+    size_t count = 0;
+    std::vector<std::vector<spatial_item>> cells{};
+    std::vector<place> places{}; // by id
+
+    int col_of(float x) const;
+    int row_of(float y) const;
+};
+
+} // pse
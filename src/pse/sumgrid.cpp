@@ -0,0 +1,270 @@
+#include <algorithm>
+
+#include "sumgrid.hpp"
+
+namespace pse {
+
+constexpr int BLOCK = PSE_SUMGRID_BLOCK;
+
+sumgrid::sumgrid()
+{
+
+}
+
+sumgrid::sumgrid(int w, int h)
+{
+    resize(w, h);
+}
+
+void sumgrid::resize(int w, int h)
+{
+    width = w;
+    height = h;
+    blocks_wide = (w + BLOCK - 1) / BLOCK;
+    blocks_tall = (h + BLOCK - 1) / BLOCK;
+    totals.clear();
+    blocks.clear();
+}
+
+void sumgrid::total_add(int bx, int by, int amount)
+{
+    if (totals.empty()) {
+        totals.assign((size_t)blocks_wide * blocks_tall, 0);
+        blocks.resize((size_t)blocks_wide * blocks_tall);
+    }
+    for (int i = by; i < blocks_tall; i |= i + 1) {
+        int32_t *row = &totals[(size_t)i * blocks_wide];
+        for (int j = bx; j < blocks_wide; j |= j + 1) {
+            row[j] += amount;
+        }
+    }
+}
+
+static inline bool by_cell(const sumgrid_entry& a, const sumgrid_entry& b)
+{
+    return a.cell < b.cell;
+}
+
+/**
+ * Keep the table up to date once a block has enough in it
+ */
+void sumgrid::block_changed(sumgrid_block& block)
+{
+    if (block.entries.size() <= (size_t)PSE_SUMGRID_DENSE) {
+        block.table = std::vector<int32_t>{};
+        return;
+    }
+    const int n = BLOCK + 1;
+    block.table.assign(n * n, 0);
+    for (const sumgrid_entry& e : block.entries) {
+        block.table[(e.cell / BLOCK + 1) * n + e.cell % BLOCK + 1] = e.amount;
+    }
+    for (int i = 1; i < n; i++) {
+        for (int j = 1; j < n; j++) {
+            block.table[i * n + j] += block.table[(i - 1) * n + j] + block.table[i * n + j - 1] - block.table[(i - 1) * n + j - 1];
+        }
+    }
+}
+
+void sumgrid::add(int x, int y, int amount)
+{
+    if (amount == 0) {
+        return;
+    }
+    total_add(x / BLOCK, y / BLOCK, amount);
+
+    sumgrid_block& block = blocks[(size_t)(y / BLOCK) * blocks_wide + x / BLOCK];
+    std::vector<sumgrid_entry>& entries = block.entries;
+    sumgrid_entry e{ (uint16_t)((y % BLOCK) * BLOCK + x % BLOCK), amount };
+    auto it = std::lower_bound(entries.begin(), entries.end(), e, by_cell);
+    if (it != entries.end() && it->cell == e.cell) {
+        it->amount += amount;
+        if (it->amount == 0) {
+            entries.erase(it);
+        }
+    }
+    else {
+        entries.insert(it, e);
+    }
+
+    if (block.table.empty() || entries.size() <= (size_t)PSE_SUMGRID_DENSE) {
+        block_changed(block);
+        return;
+    }
+    // everything below and to the right of the tile in the table
+    const int n = BLOCK + 1;
+    for (int i = y % BLOCK + 1; i < n; i++) {
+        int32_t *row = &block.table[i * n];
+        for (int j = x % BLOCK + 1; j < n; j++) {
+            row[j] += amount;
+        }
+    }
+}
+
+/**
+ * Every block the rect covers gets its new counts in order,
+ * then merges them in with one pass
+ */
+void sumgrid::add_every(int x, int y, int w, int h, int step_x, int step_y, int amount)
+{
+    if (amount == 0 || w <= 0 || h <= 0) {
+        return;
+    }
+    std::vector<sumgrid_entry> fresh;
+    std::vector<sumgrid_entry> merged;
+    for (int by = y / BLOCK; by <= (y + h - 1) / BLOCK; by++) {
+        for (int bx = x / BLOCK; bx <= (x + w - 1) / BLOCK; bx++) {
+            // first of the steps inside the block, across and down
+            int x0 = std::max(x, bx * BLOCK);
+            int y0 = std::max(y, by * BLOCK);
+            x0 += (step_x - (x0 - x) % step_x) % step_x;
+            y0 += (step_y - (y0 - y) % step_y) % step_y;
+            int x1 = std::min(x + w, (bx + 1) * BLOCK);
+            int y1 = std::min(y + h, (by + 1) * BLOCK);
+
+            fresh.clear();
+            for (int i = y0; i < y1; i += step_y) {
+                for (int j = x0; j < x1; j += step_x) {
+                    fresh.push_back(sumgrid_entry{ (uint16_t)((i % BLOCK) * BLOCK + j % BLOCK), amount });
+                }
+            }
+            if (fresh.empty()) {
+                continue;
+            }
+            total_add(bx, by, amount * (int)fresh.size());
+
+            std::vector<sumgrid_entry>& block = blocks[(size_t)by * blocks_wide + bx].entries;
+            merged.clear();
+            size_t a = 0;
+            size_t b = 0;
+            while (a < block.size() || b < fresh.size()) {
+                if (b == fresh.size() || (a < block.size() && block[a].cell < fresh[b].cell)) {
+                    merged.push_back(block[a++]);
+                }
+                else if (a == block.size() || fresh[b].cell < block[a].cell) {
+                    merged.push_back(fresh[b++]);
+                }
+                else {
+                    sumgrid_entry e{ block[a].cell, block[a].amount + fresh[b].amount };
+                    if (e.amount != 0) {
+                        merged.push_back(e);
+                    }
+                    a++;
+                    b++;
+                }
+            }
+            block.assign(merged.begin(), merged.end());
+            block_changed(blocks[(size_t)by * blocks_wide + bx]);
+        }
+    }
+}
+
+/**
+ * Every block the rect covers drops what's inside it in one pass
+ */
+void sumgrid::clear(int x, int y, int w, int h)
+{
+    if (totals.empty() || w <= 0 || h <= 0) {
+        return;
+    }
+    for (int by = y / BLOCK; by <= (y + h - 1) / BLOCK; by++) {
+        const int ly0 = std::max(y - by * BLOCK, 0);
+        const int ly1 = std::min(y + h - by * BLOCK, BLOCK);
+        for (int bx = x / BLOCK; bx <= (x + w - 1) / BLOCK; bx++) {
+            const int lx0 = std::max(x - bx * BLOCK, 0);
+            const int lx1 = std::min(x + w - bx * BLOCK, BLOCK);
+            sumgrid_block& block = blocks[(size_t)by * blocks_wide + bx];
+            int removed = 0;
+            auto kept = std::remove_if(block.entries.begin(), block.entries.end(), [&](const sumgrid_entry& e) {
+                int lx = e.cell % BLOCK;
+                int ly = e.cell / BLOCK;
+                bool inside = lx >= lx0 && lx < lx1 && ly >= ly0 && ly < ly1;
+                removed += inside ? e.amount : 0;
+                return inside;
+            });
+            if (kept == block.entries.end()) {
+                continue;
+            }
+            block.entries.erase(kept, block.entries.end());
+            total_add(bx, by, -removed);
+            block_changed(block);
+        }
+    }
+}
+
+int64_t sumgrid::blocks_to(int bx, int by) const
+{
+    int64_t s = 0;
+    for (int i = by - 1; i >= 0; i = (i & (i + 1)) - 1) {
+        const int32_t *row = &totals[(size_t)i * blocks_wide];
+        for (int j = bx - 1; j >= 0; j = (j & (j + 1)) - 1) {
+            s += row[j];
+        }
+    }
+    return s;
+}
+
+/**
+ * Blocks entirely inside the rect come from the tree, only
+ * the blocks its edges cut through are looked inside
+ */
+int64_t sumgrid::sum(int x, int y, int w, int h) const
+{
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = std::min(x + w, width);
+    int y1 = std::min(y + h, height);
+    if (totals.empty() || x0 >= x1 || y0 >= y1) {
+        return 0;
+    }
+
+    // whole blocks are [fx0, fx1) by [fy0, fy1)
+    int fx0 = (x0 + BLOCK - 1) / BLOCK;
+    int fy0 = (y0 + BLOCK - 1) / BLOCK;
+    int fx1 = x1 / BLOCK;
+    int fy1 = y1 / BLOCK;
+    if (fx0 >= fx1 || fy0 >= fy1) {
+        fx0 = fx1 = fy0 = fy1 = -1;
+    }
+    int64_t s = 0;
+    if (fx0 != -1) {
+        s = blocks_to(fx1, fy1) - blocks_to(fx0, fy1) - blocks_to(fx1, fy0) + blocks_to(fx0, fy0);
+    }
+
+    for (int by = y0 / BLOCK; by <= (y1 - 1) / BLOCK; by++) {
+        const bool whole_row = by >= fy0 && by < fy1;
+        const int ly0 = std::max(y0 - by * BLOCK, 0);
+        const int ly1 = std::min(y1 - by * BLOCK, BLOCK);
+        for (int bx = x0 / BLOCK; bx <= (x1 - 1) / BLOCK; bx++) {
+            if (whole_row && bx >= fx0 && bx < fx1) {
+                bx = fx1 - 1;
+                continue;
+            }
+            const int lx0 = std::max(x0 - bx * BLOCK, 0);
+            const int lx1 = std::min(x1 - bx * BLOCK, BLOCK);
+            const sumgrid_block& block = blocks[(size_t)by * blocks_wide + bx];
+            if (!block.table.empty()) {
+                const int32_t *t = block.table.data();
+                const int n = BLOCK + 1;
+                s += t[ly1 * n + lx1] - t[ly0 * n + lx1] - t[ly1 * n + lx0] + t[ly0 * n + lx0];
+                continue;
+            }
+            const std::vector<sumgrid_entry>& entries = block.entries;
+            auto it = std::lower_bound(entries.begin(), entries.end(), sumgrid_entry{ (uint16_t)(ly0 * BLOCK), 0 }, by_cell);
+            for (; it != entries.end() && it->cell < ly1 * BLOCK; ++it) {
+                int lx = it->cell % BLOCK;
+                if (lx >= lx0 && lx < lx1) {
+                    s += it->amount;
+                }
+            }
+        }
+    }
+    return s;
+}
+
+int sumgrid::get(int x, int y) const
+{
+    return (int)sum(x, y, 1, 1);
+}
+
+} // pse
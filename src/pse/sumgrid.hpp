@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace pse {
+
+constexpr int PSE_SUMGRID_BLOCK = 32; // tiles per side of a block
+constexpr int PSE_SUMGRID_DENSE = 64; // tiles with counts before a block keeps a summed-area table too
+
+struct sumgrid_entry {
+    uint16_t cell; // y * PSE_SUMGRID_BLOCK + x within the block
+    int32_t amount;
+};
+
+struct sumgrid_block {
+    std::vector<sumgrid_entry> entries; // sorted by cell, nothing with 0
+    std::vector<int32_t> table; // (PSE_SUMGRID_BLOCK + 1)^2 sums from the corner, empty while it's sparse
+};
+
+/**
+ * 2D grid of counts that sums any rect. The totals of each block are
+ * a Fenwick tree, so whole blocks sum in O(log w * log h), only the
+ * blocks the edges of the rect cut through are looked inside. Blocks
+ * only keep the tiles with counts, so sparse grids cost next to nothing
+ * and nothing is allocated until the first count is added. Busy blocks
+ * also keep a summed-area table so looking inside them is O(1).
+ */
+struct sumgrid {
+    int width = 0;
+    int height = 0;
+    int blocks_wide = 0;
+    int blocks_tall = 0;
+    std::vector<int32_t> totals{};
+    std::vector<sumgrid_block> blocks{};
+
+    sumgrid();
+    sumgrid(int w, int h);
+    void resize(int w, int h); // all counts are cleared
+    void add(int x, int y, int amount);
+    void add_every(int x, int y, int w, int h, int step_x, int step_y, int amount); // every step across and down a rect in bounds
+    void clear(int x, int y, int w, int h); // rect in bounds
+    int64_t sum(int x, int y, int w, int h) const; // rect is clipped to the grid
+    int get(int x, int y) const;
+private:
+    int64_t blocks_to(int bx, int by) const; // totals of the blocks in [0, bx) by [0, by)
+    void total_add(int bx, int by, int amount);
+    void block_changed(sumgrid_block& block);
+};
+
+} // pse
@@ -0,0 +1,310 @@
+#include <cassert>
+
+#include "road.hpp"
+
+static const int dir_x[ROAD_DIR_COUNT] = { 1, 0, -1, 0 };
+static const int dir_y[ROAD_DIR_COUNT] = { 0, 1, 0, -1 };
+
+static inline int opposite(int dir)
+{
+    return (dir + 2) % ROAD_DIR_COUNT;
+}
+
+// owner values of tiles that belong to an edge
+static inline int edge_owner(int edge)
+{
+    return -edge - 2;
+}
+
+static inline int owner_edge(int owner)
+{
+    return -owner - 2;
+}
+
+void RoadGraph::resize(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    owner.clear();
+    nodes.clear();
+    edges.clear();
+    free_nodes.clear();
+    free_edges.clear();
+    live_nodes = 0;
+    live_edges = 0;
+    changed_edges.clear();
+    changed_nodes.clear();
+    changed_all = true;
+    edits++;
+}
+
+bool RoadGraph::is_road(int wx, int wy) const
+{
+    return owner.count(wy * width + wx) != 0;
+}
+
+int RoadGraph::node_at(int wx, int wy) const
+{
+    auto it = owner.find(wy * width + wx);
+    return (it != owner.end() && it->second >= 0) ? it->second : -1;
+}
+
+int RoadGraph::edge_at(int wx, int wy) const
+{
+    auto it = owner.find(wy * width + wx);
+    return (it != owner.end() && it->second < -1) ? owner_edge(it->second) : -1;
+}
+
+int RoadGraph::node_count() const
+{
+    return live_nodes;
+}
+
+int RoadGraph::edge_count() const
+{
+    return live_edges;
+}
+
+unsigned RoadGraph::revision() const
+{
+    return edits;
+}
+
+/**
+ * Swap out the ids of the edges and nodes that were made or deleted,
+ * an id may be in there more than once. There's one taker, Traffic.
+ * Nothing is kept after a resize until then, it all changed anyway.
+ */
+bool RoadGraph::changes_take(std::vector<int>& edges, std::vector<int>& nodes)
+{
+    edges.clear();
+    nodes.clear();
+    edges.swap(changed_edges);
+    nodes.swap(changed_nodes);
+    bool all = changed_all;
+    changed_all = false;
+    return !all;
+}
+
+int RoadGraph::neighbour(int cell, int dir) const
+{
+    int x = cell % width + dir_x[dir];
+    int y = cell / width + dir_y[dir];
+    if (x < 0 || x >= width || y < 0 || y >= height) {
+        return -1;
+    }
+    int n = y * width + x;
+    return owner.count(n) ? n : -1;
+}
+
+int RoadGraph::degree(int cell) const
+{
+    int n = 0;
+    for (int d = 0; d < ROAD_DIR_COUNT; d++) {
+        n += neighbour(cell, d) != -1;
+    }
+    return n;
+}
+
+int RoadGraph::node_new(int cell)
+{
+    int id;
+    if (!free_nodes.empty()) {
+        id = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    else {
+        id = (int)nodes.size();
+        nodes.emplace_back();
+    }
+    nodes[id] = RoadNode{ cell, { -1, -1, -1, -1 }, true };
+    owner[cell] = id;
+    live_nodes++;
+    if (!changed_all) {
+        changed_nodes.push_back(id);
+    }
+    return id;
+}
+
+void RoadGraph::node_delete(int node)
+{
+    auto it = owner.find(nodes[node].cell);
+    if (it != owner.end()) {
+        it->second = -1;
+    }
+    nodes[node].alive = false;
+    free_nodes.push_back(node);
+    live_nodes--;
+    if (!changed_all) {
+        changed_nodes.push_back(node);
+    }
+}
+
+/**
+ * Unlink an edge, everything it touched goes into loose to be retraced
+ */
+void RoadGraph::edge_delete(int edge, std::vector<int>& loose)
+{
+    RoadEdge& e = edges[edge];
+    for (int c : e.cells) {
+        owner[c] = -1;
+        loose.push_back(c);
+    }
+    nodes[e.a].edges[e.a_dir] = -1;
+    nodes[e.b].edges[e.b_dir] = -1;
+    loose.push_back(nodes[e.a].cell);
+    loose.push_back(nodes[e.b].cell);
+    e.alive = false;
+    e.cells.clear();
+    free_edges.push_back(edge);
+    live_edges--;
+    if (!changed_all) {
+        changed_edges.push_back(edge);
+    }
+}
+
+/**
+ * Walk from a node along the road until the next node, making the edge
+ */
+void RoadGraph::trace(int node, int dir)
+{
+    int id;
+    if (!free_edges.empty()) {
+        id = free_edges.back();
+        free_edges.pop_back();
+    }
+    else {
+        id = (int)edges.size();
+        edges.emplace_back();
+    }
+    RoadEdge& e = edges[id];
+    e.a = node;
+    e.a_dir = dir;
+    e.length = 1;
+    e.alive = true;
+
+    int cur = neighbour(nodes[node].cell, dir);
+    while (owner[cur] < 0) {
+        // anything that isn't a node has exactly 2 neighbours, go out the other one
+        assert(owner[cur] == -1);
+        owner[cur] = edge_owner(id);
+        e.cells.push_back(cur);
+        int next = -1;
+        for (int d = 0; d < ROAD_DIR_COUNT; d++) {
+            if (d != opposite(dir) && (next = neighbour(cur, d)) != -1) {
+                dir = d;
+                break;
+            }
+        }
+        assert(next != -1);
+        cur = next;
+        e.length++;
+    }
+
+    e.b = owner[cur];
+    e.b_dir = opposite(dir);
+    nodes[e.a].edges[e.a_dir] = id;
+    nodes[e.b].edges[e.b_dir] = id;
+    live_edges++;
+    if (!changed_all) {
+        changed_edges.push_back(id);
+    }
+}
+
+/**
+ * Unlink whatever a tile is part of
+ */
+void RoadGraph::detach(int cell, std::vector<int>& loose)
+{
+    int o = owner[cell];
+    if (o < -1) {
+        edge_delete(owner_edge(o), loose);
+    }
+    else if (o >= 0) {
+        for (int d = 0; d < ROAD_DIR_COUNT; d++) {
+            if (nodes[o].edges[d] != -1) {
+                edge_delete(nodes[o].edges[d], loose);
+            }
+        }
+        node_delete(o);
+    }
+}
+
+/**
+ * Tear down the edges and nodes around a tile, then rebuild them.
+ * Only what the tile or its neighbours were part of is touched.
+ */
+void RoadGraph::update(int cell, bool removing)
+{
+    std::vector<int> touched{ cell };
+    for (int d = 0; d < ROAD_DIR_COUNT; d++) {
+        int n = neighbour(cell, d);
+        if (n != -1) {
+            touched.push_back(n);
+        }
+    }
+
+    std::vector<int> loose;
+    for (int t : touched) {
+        detach(t, loose);
+    }
+    if (removing) {
+        owner.erase(cell);
+    }
+
+    // intersections and dead ends
+    for (int t : touched) {
+        auto it = owner.find(t);
+        if (it != owner.end() && it->second == -1 && degree(t) != 2) {
+            node_new(t);
+        }
+    }
+
+    // edges out of every node that lost one
+    loose.insert(loose.end(), touched.begin(), touched.end());
+    for (int c : loose) {
+        auto it = owner.find(c);
+        if (it == owner.end() || it->second < 0) {
+            continue;
+        }
+        int n = it->second;
+        for (int d = 0; d < ROAD_DIR_COUNT; d++) {
+            if (nodes[n].edges[d] == -1 && neighbour(c, d) != -1) {
+                trace(n, d);
+            }
+        }
+    }
+
+    // anything left is on a loop without any nodes
+    for (int c : loose) {
+        auto it = owner.find(c);
+        if (it == owner.end() || it->second != -1) {
+            continue;
+        }
+        int n = node_new(c);
+        for (int d = 0; d < ROAD_DIR_COUNT; d++) {
+            if (nodes[n].edges[d] == -1 && neighbour(c, d) != -1) {
+                trace(n, d);
+            }
+        }
+    }
+}
+
+void RoadGraph::add(int wx, int wy)
+{
+    if (wx < 0 || wx >= width || wy < 0 || wy >= height || is_road(wx, wy)) {
+        return;
+    }
+    owner[wy * width + wx] = -1;
+    update(wy * width + wx, false);
+    edits++;
+}
+
+void RoadGraph::remove(int wx, int wy)
+{
+    if (wx < 0 || wx >= width || wy < 0 || wy >= height || !is_road(wx, wy)) {
+        return;
+    }
+    update(wy * width + wx, true);
+    edits++;
+}
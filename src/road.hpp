@@ -0,0 +1,77 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+// directions between neighbouring tiles, the opposite of d is (d + 2) % 4
+enum RoadDir {
+    ROAD_EAST,  // +x
+    ROAD_SOUTH, // +y
+    ROAD_WEST,  // -x
+    ROAD_NORTH, // -y
+    ROAD_DIR_COUNT
+};
+
+struct RoadNode {
+    int cell; // tile index, wy * width + wx
+    int edges[ROAD_DIR_COUNT]; // edge leaving in each direction, -1 for none
+    bool alive;
+};
+
+struct RoadEdge {
+    int a; // node at each end, a == b for a loop
+    int b;
+    int a_dir; // direction the edge leaves each node in
+    int b_dir;
+    int length; // tiles walked from a to b
+    std::vector<int> cells; // tiles between a and b, from a
+    bool alive;
+};
+
+/**
+ * Connectivity of the road tiles. Intersections and dead ends are nodes,
+ * the runs of road between them are edges weighted by their length.
+ * A loop without any of those gets a node anywhere on it.
+ *
+ * Adding or removing a tile only retraces the edges that
+ * pass through it or its neighbours. Those edges and nodes are kept
+ * until taken, so whatever follows the graph can do the same.
+ */
+class RoadGraph {
+public:
+    std::vector<RoadNode> nodes{}; // dead ones are reused, check alive
+    std::vector<RoadEdge> edges{};
+
+    void resize(int width, int height); // removes every road
+    void add(int wx, int wy);
+    void remove(int wx, int wy);
+    bool is_road(int wx, int wy) const;
+    int node_at(int wx, int wy) const; // -1 if it is not a node
+    int edge_at(int wx, int wy) const; // edge running through the tile, -1 if none
+    int node_count() const;
+    int edge_count() const;
+    unsigned revision() const; // changes whenever a road is added or removed
+    bool changes_take(std::vector<int>& edges, std::vector<int>& nodes); // made or deleted since the last take, false if everything was
+    int width = 0;
+    int height = 0;
+private:
+    unsigned edits = 0;
+    std::vector<int> changed_edges{};
+    std::vector<int> changed_nodes{};
+    bool changed_all = true;
+    // road tile -> what it belongs to, >= 0 is a node, < -1 is ~edge - 1, -1 is nothing yet
+    std::unordered_map<int, int> owner{};
+    std::vector<int> free_nodes{};
+    std::vector<int> free_edges{};
+    int live_nodes = 0;
+    int live_edges = 0;
+
+    int neighbour(int cell, int dir) const; // -1 if it's off the map or not a road
+    int degree(int cell) const;
+    int node_new(int cell);
+    void node_delete(int node);
+    void edge_delete(int edge, std::vector<int>& loose);
+    void detach(int cell, std::vector<int>& loose);
+    void trace(int node, int dir);
+    void update(int cell, bool removing);
+};
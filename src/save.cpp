@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include "save.hpp"
+
+using namespace pse;
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static inline void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        v |= (uint32_t)p[i] << (i * 8);
+    }
+    return v;
+}
+
+static inline uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t)p[i] << (i * 8);
+    }
+    return v;
+}
+
+void save_encode(const uint8_t *codes, int count, std::vector<uint8_t>& out)
+{
+    int i = 0;
+    while (i < count) {
+        int run = 1;
+        while (i + run < count && codes[i + run] == codes[i]) {
+            run++;
+        }
+        out.push_back(codes[i]);
+        unsigned n = (unsigned)run;
+        while (n >= 0x80) {
+            out.push_back((uint8_t)(n | 0x80));
+            n >>= 7;
+        }
+        out.push_back((uint8_t)n);
+        i += run;
+    }
+}
+
+bool save_decode(const uint8_t *data, size_t size, uint8_t *codes, int count)
+{
+    size_t p = 0;
+    int i = 0;
+    while (p < size) {
+        uint8_t code = data[p++];
+        unsigned n = 0;
+        int shift = 0;
+        for (;;) {
+            if (p >= size || shift > 28) {
+                return false;
+            }
+            uint8_t b = data[p++];
+            n |= (unsigned)(b & 0x7f) << shift;
+            shift += 7;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        if (n > (unsigned)(count - i)) {
+            return false;
+        }
+        memset(codes + i, code, n);
+        i += (int)n;
+    }
+    return i == count;
+}
+
+/**
+ * Only the header and the index are read here, the index
+ * is checked so chunks can be read later without checks
+ */
+bool SaveFile::open(const char *path)
+{
+    if (!file.open(path)) {
+        return false;
+    }
+    const uint8_t *d = file.data();
+    if (file.size() < SAVE_HEADER_SIZE || get_u32(d) != SAVE_MAGIC || get_u32(d + 4) != SAVE_VERSION) {
+        file.close();
+        return false;
+    }
+    width = (int)get_u32(d + 8);
+    height = (int)get_u32(d + 12);
+    chunk_size = (int)get_u32(d + 16);
+    int chunks = (int)get_u32(d + 20);
+    generation = get_u64(d + 24);
+    if (width <= 0 || height <= 0 || chunk_size <= 0 || chunk_size > 256) {
+        file.close();
+        return false;
+    }
+    chunks_wide = (width + chunk_size - 1) / chunk_size;
+    chunks_tall = (height + chunk_size - 1) / chunk_size;
+    if (chunks != chunks_wide * chunks_tall || file.size() < SAVE_HEADER_SIZE + (size_t)chunks * SAVE_INDEX_SIZE) {
+        file.close();
+        return false;
+    }
+    for (int c = 0; c < chunks; c++) {
+        const uint8_t *e = d + SAVE_HEADER_SIZE + (size_t)c * SAVE_INDEX_SIZE;
+        uint64_t offset = get_u64(e);
+        uint64_t size = get_u32(e + 8);
+        if (offset > file.size() || size > file.size() - offset) {
+            file.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+int SaveFile::objects(int chunk) const
+{
+    return (int)get_u32(file.data() + SAVE_HEADER_SIZE + (size_t)chunk * SAVE_INDEX_SIZE + 12);
+}
+
+const uint8_t *SaveFile::chunk_data(int chunk, size_t& size) const
+{
+    const uint8_t *e = file.data() + SAVE_HEADER_SIZE + (size_t)chunk * SAVE_INDEX_SIZE;
+    size = get_u32(e + 8);
+    return file.data() + get_u64(e);
+}
+
+bool SaveFile::chunk_codes(int chunk, uint8_t *codes) const
+{
+    size_t size;
+    const uint8_t *data = chunk_data(chunk, size);
+    if (size == 0) {
+        memset(codes, 0, (size_t)chunk_size * chunk_size);
+        return true;
+    }
+    return save_decode(data, size, codes, chunk_size * chunk_size);
+}
+
+/**
+ * Replace the save in one step so a crash
+ * mid write never leaves half of one
+ */
+static bool replace_file(const char *from, const char *to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+bool save_write(SaveJob& job)
+{
+    const WorldSnapshot& world = job.world;
+    const ChunkTable& table = *world.chunks;
+    const size_t chunks = table.size();
+
+    // chunks still in the save they came from are copied as they are
+    std::vector<std::vector<uint8_t>> encoded(chunks);
+    std::vector<int> objects(chunks, 0);
+    for (size_t c = 0; c < chunks; c++) {
+        if (table[c]) {
+            for (uint8_t code : *table[c]) {
+                objects[c] += code != 0;
+            }
+            if (objects[c] > 0) {
+                save_encode(table[c]->data(), (int)table[c]->size(), encoded[c]);
+            }
+        }
+        else if (world.file && world.file->objects((int)c) > 0) {
+            size_t size;
+            const uint8_t *data = world.file->chunk_data((int)c, size);
+            encoded[c].assign(data, data + size);
+            objects[c] = world.file->objects((int)c);
+        }
+    }
+
+    std::vector<uint8_t> head(SAVE_HEADER_SIZE + chunks * SAVE_INDEX_SIZE, 0);
+    put_u32(&head[0], SAVE_MAGIC);
+    put_u32(&head[4], SAVE_VERSION);
+    put_u32(&head[8], (uint32_t)world.width);
+    put_u32(&head[12], (uint32_t)world.height);
+    put_u32(&head[16], (uint32_t)world.chunk_size);
+    put_u32(&head[20], (uint32_t)chunks);
+    put_u64(&head[24], job.generation);
+    uint64_t offset = head.size();
+    for (size_t c = 0; c < chunks; c++) {
+        uint8_t *e = &head[SAVE_HEADER_SIZE + c * SAVE_INDEX_SIZE];
+        put_u64(e, encoded[c].empty() ? 0 : offset);
+        put_u32(e + 8, (uint32_t)encoded[c].size());
+        put_u32(e + 12, (uint32_t)objects[c]);
+        offset += encoded[c].size();
+    }
+
+    std::string tmp = job.path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "Error: Could not write %s\n", tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(head.data(), 1, head.size(), f) == head.size();
+    for (const std::vector<uint8_t>& e : encoded) {
+        ok = ok && fwrite(e.data(), 1, e.size(), f) == e.size();
+    }
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || !replace_file(tmp.c_str(), job.path.c_str())) {
+        fprintf(stderr, "Error: Could not save %s\n", job.path.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pse/pse.hpp"
+#include "snapshot.hpp"
+
+/* A save is a header, an index with an entry for every chunk, then the
+   chunks. Each chunk is CHUNK_SIZE x CHUNK_SIZE codes, the TileName of
+   the object drawn from a tile or 0 for none, run length encoded as a
+   code byte then the run length in 7 bit groups, low first. Chunks with
+   nothing in them have no data. Numbers are little endian. The header
+   has the generation of the save, journals of that generation and on
+   are edits made on top of it. */
+
+constexpr uint32_t SAVE_MAGIC = 0x4c494d53; // "SMIL"
+constexpr uint32_t SAVE_VERSION = 1;
+constexpr size_t SAVE_HEADER_SIZE = 32;
+constexpr size_t SAVE_INDEX_SIZE = 16; // per chunk: offset, size, objects
+
+void save_encode(const uint8_t *codes, int count, std::vector<uint8_t>& out); // appends
+bool save_decode(const uint8_t *data, size_t size, uint8_t *codes, int count); // false if it's corrupt
+
+/**
+ * A save opened for reading, mapped rather than read in
+ * so chunks only cost anything when they are decoded
+ */
+class SaveFile {
+public:
+    bool open(const char *path); // false if it isn't a save of this version
+    int width = 0;
+    int height = 0;
+    int chunk_size = 0;
+    int chunks_wide = 0;
+    int chunks_tall = 0;
+    uint64_t generation = 0;
+    int objects(int chunk) const; // 0 for an empty chunk
+    const uint8_t *chunk_data(int chunk, size_t& size) const; // still encoded
+    bool chunk_codes(int chunk, uint8_t *codes) const; // chunk_size * chunk_size of them
+private:
+    pse::mapfile file{};
+};
+
+/**
+ * Everything a save needs is in a snapshot of the world, so the encoding
+ * and writing can happen on a worker while play goes on
+ */
+struct SaveJob {
+    std::string path;
+    uint64_t generation;
+    WorldSnapshot world;
+    std::atomic<bool> done{false};
+    std::atomic<bool> ok{false};
+};
+
+bool save_write(SaveJob& job); // encodes the world, writes beside the save and then replaces it
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "sim.hpp"
+
+using namespace pse;
+
+// land value each kind of tile pulls towards
+constexpr int VALUE_OPEN = 32;
+constexpr int VALUE_ROAD = 64;
+constexpr int VALUE_BUILDING = 128;
+
+// open land grows above this value and shrinks below the other
+constexpr int GROW_VALUE = 80;
+constexpr int DECAY_VALUE = 40;
+
+// chance out of 256 each tick that a burning neighbour sets a building alight
+constexpr uint32_t FIRE_SPREAD = 64;
+
+static inline uint32_t mix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+CitySim::CitySim(pool& workers)
+: workers{workers}
+{
+
+}
+
+void CitySim::resize(int width, int height, int chunk_size)
+{
+    this->width = width;
+    this->height = height;
+    this->chunk_size = chunk_size;
+    chunks_wide = (width + chunk_size - 1) / chunk_size;
+    chunks_tall = (height + chunk_size - 1) / chunk_size;
+
+    const int tiles = chunk_size * chunk_size;
+    chunks.assign(chunks_wide * chunks_tall, SimChunk{});
+    for (SimChunk& c : chunks) {
+        c.kind.assign(tiles, SIM_OPEN);
+        for (int f = 0; f < SIM_FIELD_COUNT; f++) {
+            c.fields[f][0].assign(tiles, f == SIM_VALUE ? VALUE_OPEN : 0);
+            c.fields[f][1] = c.fields[f][0];
+        }
+        c.active = false;
+        c.changed = false;
+    }
+    active.clear();
+    cur = 0;
+    pending = 0.0f;
+}
+
+uint8_t& CitySim::at(SimField field, int buffer, int wx, int wy)
+{
+    SimChunk& c = chunks[(wy / chunk_size) * chunks_wide + wx / chunk_size];
+    return c.fields[field][buffer][(wy % chunk_size) * chunk_size + wx % chunk_size];
+}
+
+int CitySim::get(SimField field, int wx, int wy) const
+{
+    const SimChunk& c = chunks[(wy / chunk_size) * chunks_wide + wx / chunk_size];
+    return c.fields[field][cur][(wy % chunk_size) * chunk_size + wx % chunk_size];
+}
+
+int CitySim::active_chunks() const
+{
+    return (int)active.size();
+}
+
+void CitySim::wake(int chunk)
+{
+    if (!chunks[chunk].active) {
+        chunks[chunk].active = true;
+        active.push_back(chunk);
+    }
+}
+
+/**
+ * Both buffers are written, the tile starts over as whatever was put on it
+ */
+void CitySim::set_kind(int wx, int wy, int w, int h, SimKind kind)
+{
+    for (int y = wy; y < wy + h; y++) {
+        for (int x = wx; x < wx + w; x++) {
+            SimChunk& c = chunks[(y / chunk_size) * chunks_wide + x / chunk_size];
+            c.kind[(y % chunk_size) * chunk_size + x % chunk_size] = (uint8_t)kind;
+            for (int b = 0; b < 2; b++) {
+                at(SIM_GROWTH, b, x, y) = 0;
+                at(SIM_FIRE, b, x, y) = 0;
+            }
+        }
+    }
+    for (int cy = wy / chunk_size; cy <= (wy + h - 1) / chunk_size; cy++) {
+        for (int cx = wx / chunk_size; cx <= (wx + w - 1) / chunk_size; cx++) {
+            wake(cy * chunks_wide + cx);
+        }
+    }
+}
+
+void CitySim::ignite(int wx, int wy)
+{
+    const SimChunk& c = chunks[(wy / chunk_size) * chunks_wide + wx / chunk_size];
+    if (c.kind[(wy % chunk_size) * chunk_size + wx % chunk_size] != SIM_BUILDING || at(SIM_FIRE, cur, wx, wy) != 0) {
+        return;
+    }
+    at(SIM_FIRE, 0, wx, wy) = SIM_FIRE_TICKS;
+    at(SIM_FIRE, 1, wx, wy) = SIM_FIRE_TICKS;
+    wake((wy / chunk_size) * chunks_wide + wx / chunk_size);
+}
+
+/**
+ * Next state of one chunk. Last tick's state is copied out with a one
+ * tile border from the chunks around it, tiles past the edge of the
+ * world repeat the edge.
+ */
+void CitySim::run(int chunk)
+{
+    const int s = chunk_size;
+    const int hs = s + 2;
+    const int x0 = (chunk % chunks_wide) * s;
+    const int y0 = (chunk / chunks_wide) * s;
+    const int x1 = std::min(x0 + s, width);
+    const int y1 = std::min(y0 + s, height);
+
+    thread_local std::vector<uint8_t> halo[SIM_FIELD_COUNT];
+    for (int f = 0; f < SIM_FIELD_COUNT; f++) {
+        halo[f].resize(hs * hs);
+    }
+    for (int hy = 0; hy < hs; hy++) {
+        int gy = std::min(std::max(y0 + hy - 1, 0), height - 1);
+        for (int hx = 0; hx < hs; hx++) {
+            int gx = std::min(std::max(x0 + hx - 1, 0), width - 1);
+            const SimChunk& from = chunks[(gy / s) * chunks_wide + gx / s];
+            int l = (gy % s) * s + gx % s;
+            for (int f = 0; f < SIM_FIELD_COUNT; f++) {
+                halo[f][hy * hs + hx] = from.fields[f][cur][l];
+            }
+        }
+    }
+
+    SimChunk& c = chunks[chunk];
+    const uint8_t *value = halo[SIM_VALUE].data();
+    const uint8_t *growth = halo[SIM_GROWTH].data();
+    const uint8_t *fire = halo[SIM_FIRE].data();
+    uint8_t *next_value = c.fields[SIM_VALUE][cur ^ 1].data();
+    uint8_t *next_growth = c.fields[SIM_GROWTH][cur ^ 1].data();
+    uint8_t *next_fire = c.fields[SIM_FIRE][cur ^ 1].data();
+    bool changed = false;
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            const int l = (y - y0) * s + (x - x0);
+            const int h = (y - y0 + 1) * hs + (x - x0 + 1);
+            const int kind = c.kind[l];
+
+            int f = fire[h];
+            if (f == SIM_BURNT) {
+                // stays burnt until something new is put there
+            }
+            else if (f > 0) {
+                f = f == 1 ? SIM_BURNT : f - 1;
+            }
+            else if (kind == SIM_BUILDING) {
+                auto burning = [](int n) { return n > 0 && n != SIM_BURNT; };
+                if ((burning(fire[h - 1]) || burning(fire[h + 1]) || burning(fire[h - hs]) || burning(fire[h + hs])) &&
+                    (mix((uint32_t)(y * width + x) ^ mix(ticks)) & 255) < FIRE_SPREAD)
+                {
+                    f = SIM_FIRE_TICKS;
+                }
+            }
+
+            int target = kind == SIM_ROAD ? VALUE_ROAD : kind == SIM_BUILDING ? VALUE_BUILDING : VALUE_OPEN + growth[h] / 4;
+            if (f == SIM_BURNT) {
+                target = 0;
+            }
+            int v = value[h];
+            int nv = (2 * target + 2 * v + value[h - 1] + value[h + 1] + value[h - hs] + value[h + hs]) / 8;
+            if (std::abs(nv - v) <= 1) {
+                nv = v; // close enough, lets the chunk settle
+            }
+
+            int g = growth[h];
+            if (kind != SIM_OPEN) {
+                g = 0;
+            }
+            else if (v >= GROW_VALUE && g < 255) {
+                g++;
+            }
+            else if (v < DECAY_VALUE && g > 0) {
+                g--;
+            }
+
+            changed |= nv != v || g != growth[h] || f != fire[h];
+            next_value[l] = (uint8_t)nv;
+            next_growth[l] = (uint8_t)g;
+            next_fire[l] = (uint8_t)f;
+        }
+    }
+    c.changed = changed;
+}
+
+void CitySim::tick()
+{
+    frame_vector<int> ran(active.begin(), active.end());
+    active.clear();
+    workers.parallel_for((int)ran.size(), [this, &ran](int i) {
+        run(ran[i]);
+    });
+    cur ^= 1;
+    ticks++;
+
+    // whatever changed runs again, and so do the chunks around it
+    for (int c : ran) {
+        chunks[c].active = false;
+    }
+    for (int c : ran) {
+        if (!chunks[c].changed) {
+            continue;
+        }
+        int cx = c % chunks_wide;
+        int cy = c / chunks_wide;
+        wake(c);
+        if (cx > 0) wake(c - 1);
+        if (cx + 1 < chunks_wide) wake(c + 1);
+        if (cy > 0) wake(c - chunks_wide);
+        if (cy + 1 < chunks_tall) wake(c + chunks_wide);
+    }
+}
+
+void CitySim::update(float dt)
+{
+    pending += dt;
+    if (pending >= SIM_TICK) {
+        tick();
+        pending = std::min(pending - SIM_TICK, SIM_TICK);
+    }
+}
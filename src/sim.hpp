@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pse/pse.hpp"
+
+enum SimKind {
+    SIM_OPEN,     // grass and anything else that can grow
+    SIM_ROAD,
+    SIM_BUILDING, // can burn
+};
+
+enum SimField {
+    SIM_VALUE,  // land value, drifts towards what the tile and its neighbours are worth
+    SIM_GROWTH, // how built up open land is, grows where land value is high
+    SIM_FIRE,   // 0 not burning, 1..SIM_FIRE_TICKS burning, SIM_BURNT after
+    SIM_FIELD_COUNT
+};
+
+constexpr float SIM_TICK = 0.25f; // seconds per tick
+constexpr int SIM_FIRE_TICKS = 12;
+constexpr int SIM_BURNT = 255;
+
+// the state of one chunk, every field has last tick's values and this tick's
+struct SimChunk {
+    std::vector<uint8_t> kind; // SimKind
+    std::vector<uint8_t> fields[SIM_FIELD_COUNT][2];
+    bool active;
+    bool changed;
+};
+
+/**
+ * Cellular automaton over the tiles. Each tick reads last tick's state
+ * and writes the next one, chunk by chunk on the worker pool.
+ *
+ * Only chunks that were edited, changed last tick or sit next to one
+ * that did are run, so settled parts of the map cost nothing. A chunk
+ * that isn't run has the same values in both buffers, which is what
+ * lets the buffers flip for every chunk at once.
+ */
+class CitySim {
+public:
+    CitySim(pse::pool& workers);
+    void resize(int width, int height, int chunk_size);
+    void set_kind(int wx, int wy, int w, int h, SimKind kind); // rect must be in bounds
+    void ignite(int wx, int wy);
+    int get(SimField field, int wx, int wy) const;
+    void update(float dt); // ticks once SIM_TICK has passed
+    void tick();
+    int active_chunks() const;
+    int width = 0;
+    int height = 0;
+    int chunk_size = 0;
+    int chunks_wide = 0;
+    int chunks_tall = 0;
+private:
+    pse::pool& workers;
+    std::vector<SimChunk> chunks{};
+    std::vector<int> active{};
+    int cur = 0; // buffer holding the current state
+    unsigned ticks = 0;
+    float pending = 0.0f;
+
+    void wake(int chunk);
+    void run(int chunk);
+    uint8_t& at(SimField field, int buffer, int wx, int wy);
+};
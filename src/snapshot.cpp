@@ -0,0 +1,41 @@
+#include <cstring>
+
+#include "save.hpp"
+#include "snapshot.hpp"
+
+bool WorldSnapshot::valid() const
+{
+    return chunks != nullptr;
+}
+
+bool WorldSnapshot::chunk_codes(int chunk, uint8_t *codes) const
+{
+    const ChunkTable& t = *chunks;
+    if (t[chunk]) {
+        memcpy(codes, t[chunk]->data(), t[chunk]->size());
+        return true;
+    }
+    if (file && file->objects(chunk) > 0) {
+        return file->chunk_codes(chunk, codes);
+    }
+    memset(codes, 0, (size_t)chunk_size * chunk_size);
+    return true;
+}
+
+int WorldSnapshot::code(int x, int y) const
+{
+    if (x < 0 || x >= width || y < 0 || y >= height) {
+        return 0;
+    }
+    int chunk = y / chunk_size * chunks_wide + x / chunk_size;
+    int cell = y % chunk_size * chunk_size + x % chunk_size;
+    const ChunkTable& t = *chunks;
+    if (t[chunk]) {
+        return (*t[chunk])[cell];
+    }
+    if (!file || file->objects(chunk) == 0) {
+        return 0;
+    }
+    std::vector<uint8_t> codes((size_t)chunk_size * chunk_size);
+    return file->chunk_codes(chunk, codes.data()) ? codes[cell] : 0;
+}
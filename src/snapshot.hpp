@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class SaveFile;
+
+/* The codes of one chunk, chunk_size x chunk_size of them row by row, the
+   TileName of the object drawn from each tile or 0 for none */
+typedef std::vector<uint8_t> ChunkCodes;
+
+/* Codes of every chunk, a chunk without any is empty or still in a save */
+typedef std::vector<std::shared_ptr<ChunkCodes>> ChunkTable;
+
+/**
+ * What every tile of the world is at one moment. The table and its chunks
+ * are shared with the world, which copies them before it writes to them
+ * while a snapshot still has them, so taking one is a couple of pointer
+ * copies and reading one from another thread needs no locks.
+ */
+struct WorldSnapshot {
+    int width = 0;
+    int height = 0;
+    int chunk_size = 0;
+    int chunks_wide = 0;
+    int chunks_tall = 0;
+    std::shared_ptr<const ChunkTable> chunks{};
+    std::shared_ptr<const SaveFile> file{}; // chunks without codes that have objects are still in it
+
+    bool valid() const;
+    bool chunk_codes(int chunk, uint8_t *codes) const; // chunk_size * chunk_size of them, false if the save is corrupt
+    int code(int x, int y) const; // decodes the chunk each time while it's in the save, use chunk_codes for many
+};
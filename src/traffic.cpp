@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <numeric>
+
+#include "traffic.hpp"
+
+using namespace pse;
+
+// lanes or intersections a worker takes at once
+constexpr int TRAFFIC_BLOCK = 64;
+
+static inline uint32_t next_seed(uint32_t s)
+{
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+Traffic::Traffic(RoadGraph& roads, pool& workers)
+: roads{roads}, workers{workers}
+{
+
+}
+
+size_t Traffic::vehicle_count() const
+{
+    size_t n = 0;
+    for (const TrafficLane& l : lanes) {
+        n += l.pos.size();
+    }
+    for (const TrafficNode& tn : nodes) {
+        n += tn.queue.size();
+    }
+    return n;
+}
+
+static void lane_sort(TrafficLane& lane)
+{
+    std::vector<int> order(lane.pos.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return lane.pos[a] > lane.pos[b]; });
+    std::vector<float> pos(order.size());
+    std::vector<float> speed(order.size());
+    std::vector<uint32_t> seed(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        pos[i] = lane.pos[order[i]];
+        speed[i] = lane.speed[order[i]];
+        seed[i] = lane.seed[order[i]];
+    }
+    lane.pos.swap(pos);
+    lane.speed.swap(speed);
+    lane.seed.swap(seed);
+}
+
+/**
+ * Put a vehicle on the tile it's on, heading towards next. The lanes
+ * it goes into need sorting after.
+ */
+static bool place(RoadGraph& roads, std::vector<TrafficLane>& lanes, std::vector<TrafficNode>& nodes,
+                  int cell, int next, float frac, float speed, uint32_t seed)
+{
+    const int x = cell % roads.width;
+    const int y = cell / roads.width;
+    int n = roads.node_at(x, y);
+    if (n != -1) {
+        nodes[n].queue.push_back(TrafficWaiting{ seed, -1 });
+        return true;
+    }
+    int e = roads.edge_at(x, y);
+    if (e == -1) {
+        return false;
+    }
+
+    // path from a to b is a, the edge's cells, then b
+    const std::vector<int>& cells = roads.edges[e].cells;
+    int k = (int)(std::find(cells.begin(), cells.end(), cell) - cells.begin()) + 1;
+    int back = k == 1 ? roads.nodes[roads.edges[e].a].cell : cells[k - 2];
+    TrafficLane& lane = (next == back) ? lanes[e * 2 + 1] : lanes[e * 2];
+    float along = (next == back) ? (roads.edges[e].length - k) + frac : k + frac;
+    lane.pos.push_back(along);
+    lane.speed.push_back(speed);
+    lane.seed.push_back(seed);
+    return true;
+}
+
+/**
+ * Remember where the vehicles on a lane are, in tiles, so they can
+ * be put back once the road under them is retraced
+ */
+static void lane_spots(const TrafficLane& l, std::vector<TrafficSpot>& out)
+{
+    for (size_t i = 0; i < l.pos.size(); i++) {
+        int k = std::min((int)l.pos[i], (int)l.path.size() - 2);
+        out.push_back(TrafficSpot{ l.path[k], l.path[k + 1], l.pos[i] - k, l.speed[i], l.seed[i] });
+    }
+}
+
+static void node_spots(const TrafficNode& tn, std::vector<TrafficSpot>& out)
+{
+    for (const TrafficWaiting& w : tn.queue) {
+        out.push_back(TrafficSpot{ tn.cell, -1, 0.0f, 0.0f, w.seed });
+    }
+}
+
+static void lane_unlink(std::vector<int>& list, int lane)
+{
+    list.erase(std::remove(list.begin(), list.end(), lane), list.end());
+}
+
+/**
+ * Make both lanes of an edge and link them into its nodes
+ */
+void Traffic::lane_build(int e)
+{
+    const RoadEdge& edge = roads.edges[e];
+    TrafficLane& ab = lanes[e * 2];
+    TrafficLane& ba = lanes[e * 2 + 1];
+    ab = TrafficLane{};
+    ba = TrafficLane{};
+    if (!edge.alive) {
+        return;
+    }
+    ab.from = ba.to = edge.a;
+    ab.to = ba.from = edge.b;
+    ab.length = ba.length = (float)edge.length;
+    ab.path.push_back(roads.nodes[edge.a].cell);
+    ab.path.insert(ab.path.end(), edge.cells.begin(), edge.cells.end());
+    ab.path.push_back(roads.nodes[edge.b].cell);
+    ba.path.assign(ab.path.rbegin(), ab.path.rend());
+    ab.occupancy.assign(ab.path.size(), 0);
+    ba.occupancy.assign(ba.path.size(), 0);
+    nodes[edge.a].out.push_back(e * 2);
+    nodes[edge.b].in.push_back(e * 2);
+    nodes[edge.b].out.push_back(e * 2 + 1);
+    nodes[edge.a].in.push_back(e * 2 + 1);
+}
+
+/**
+ * Rebuild every lane from the road graph, keeping
+ * every vehicle that is still on a road
+ */
+void Traffic::rebuild()
+{
+    spots.clear();
+    for (const TrafficLane& l : lanes) {
+        lane_spots(l, spots);
+    }
+    for (const TrafficNode& tn : nodes) {
+        node_spots(tn, spots);
+    }
+
+    lanes.assign(roads.edges.size() * 2, TrafficLane{});
+    nodes.assign(roads.nodes.size(), TrafficNode{});
+    for (size_t n = 0; n < roads.nodes.size(); n++) {
+        nodes[n].cell = roads.nodes[n].cell;
+    }
+    for (size_t e = 0; e < roads.edges.size(); e++) {
+        lane_build((int)e);
+    }
+
+    for (const TrafficSpot& s : spots) {
+        place(roads, lanes, nodes, s.cell, s.next, s.frac, s.speed, s.seed);
+    }
+    for (TrafficLane& l : lanes) {
+        lane_sort(l);
+    }
+}
+
+/**
+ * Follow the road graph's changes. Only the lanes of edges it deleted
+ * or traced are rebuilt and only their vehicles, and those waiting at
+ * nodes it deleted or made, are put back.
+ */
+void Traffic::sync()
+{
+    if (!roads.changes_take(changed_edges, changed_nodes)) {
+        rebuild();
+        return;
+    }
+    if (changed_edges.empty() && changed_nodes.empty()) {
+        return;
+    }
+    std::sort(changed_edges.begin(), changed_edges.end());
+    changed_edges.erase(std::unique(changed_edges.begin(), changed_edges.end()), changed_edges.end());
+    std::sort(changed_nodes.begin(), changed_nodes.end());
+    changed_nodes.erase(std::unique(changed_nodes.begin(), changed_nodes.end()), changed_nodes.end());
+
+    // take the vehicles off and unlink the lanes as they were
+    spots.clear();
+    for (int e : changed_edges) {
+        for (int l = e * 2; l <= e * 2 + 1 && l < (int)lanes.size(); l++) {
+            TrafficLane& lane = lanes[l];
+            if (lane.path.empty()) {
+                continue;
+            }
+            lane_spots(lane, spots);
+            lane_unlink(nodes[lane.from].out, l);
+            lane_unlink(nodes[lane.to].in, l);
+            lane = TrafficLane{};
+        }
+    }
+    for (int n : changed_nodes) {
+        if (n < (int)nodes.size()) {
+            node_spots(nodes[n], spots);
+            nodes[n].queue.clear();
+        }
+    }
+
+    // a deleted node lost all of its edges, so it has no lanes left to keep
+    lanes.resize(roads.edges.size() * 2, TrafficLane{});
+    nodes.resize(roads.nodes.size(), TrafficNode{});
+    for (int n : changed_nodes) {
+        nodes[n].cell = roads.nodes[n].cell;
+    }
+    for (int e : changed_edges) {
+        lane_build(e);
+    }
+
+    // anything still on a road is now on one of those lanes or nodes
+    for (const TrafficSpot& s : spots) {
+        place(roads, lanes, nodes, s.cell, s.next, s.frac, s.speed, s.seed);
+    }
+    for (int e : changed_edges) {
+        lane_sort(lanes[e * 2]);
+        lane_sort(lanes[e * 2 + 1]);
+    }
+}
+
+bool Traffic::spawn(int wx, int wy, uint32_t seed)
+{
+    if (!roads.is_road(wx, wy)) {
+        return false;
+    }
+    sync();
+
+    const int cell = wy * roads.width + wx;
+    seed = seed ? seed : 1;
+    int e = roads.edge_at(wx, wy);
+    place(roads, lanes, nodes, cell, -1, 0.5f, 0.0f, seed);
+    if (e != -1) {
+        lane_sort(lanes[e * 2]);
+    }
+    return true;
+}
+
+/**
+ * Every vehicle speeds up towards the limit but never closes the gap
+ * to the one in front by more than the spacing. The same few operations
+ * run over the whole lane so the loops vectorise. The front vehicle may
+ * run into the intersection unless its queue is full.
+ */
+void Traffic::lane_step(TrafficLane& lane)
+{
+    const int n = (int)lane.pos.size();
+    if (n == 0) {
+        return;
+    }
+    float *pos = lane.pos.data();
+    float *speed = lane.speed.data();
+
+    lane.gap.resize(n);
+    float *gap = lane.gap.data();
+    const bool backed_up = nodes[lane.to].queue.size() >= INTERSECTION_QUEUE;
+    gap[0] = backed_up ? lane.length - pos[0] - 0.001f : VEHICLE_SPEED;
+    for (int i = 1; i < n; i++) {
+        gap[i] = pos[i - 1] - pos[i] - VEHICLE_SPACING;
+    }
+
+    const float dt = TRAFFIC_STEP;
+    for (int i = 0; i < n; i++) {
+        float v = std::min(speed[i] + VEHICLE_ACCEL * dt, VEHICLE_SPEED);
+        v = std::min(v, std::max(gap[i], 0.0f) / dt);
+        speed[i] = v;
+        pos[i] += v * dt;
+    }
+
+    int arrived = 0;
+    while (arrived < n && pos[arrived] >= lane.length) {
+        lane.arrived.push_back(lane.seed[arrived]);
+        arrived++;
+    }
+    if (arrived) {
+        lane.pos.erase(lane.pos.begin(), lane.pos.begin() + arrived);
+        lane.speed.erase(lane.speed.begin(), lane.speed.begin() + arrived);
+        lane.seed.erase(lane.seed.begin(), lane.seed.begin() + arrived);
+    }
+
+    std::fill(lane.occupancy.begin(), lane.occupancy.end(), 0);
+    for (float p : lane.pos) {
+        lane.occupancy[(int)p]++;
+    }
+}
+
+/**
+ * Take in what arrived from the lanes ending here, then let the front
+ * of the queue out onto a lane leaving here. Vehicles only turn back
+ * the way they came at dead ends, and wait while their lane is full.
+ */
+void Traffic::node_step(int node)
+{
+    TrafficNode& tn = nodes[node];
+    for (int l : tn.in) {
+        for (uint32_t seed : lanes[l].arrived) {
+            tn.queue.push_back(TrafficWaiting{ seed, l });
+        }
+        lanes[l].arrived.clear();
+    }
+    if (tn.out.empty()) {
+        return;
+    }
+
+    for (int r = 0; r < INTERSECTION_RELEASE && !tn.queue.empty(); r++) {
+        TrafficWaiting& w = tn.queue.front();
+        const int back = w.from_lane == -1 ? -1 : (w.from_lane ^ 1);
+        int choices = 0;
+        for (int l : tn.out) {
+            choices += l != back;
+        }
+
+        uint32_t seed = next_seed(w.seed);
+        int pick = back;
+        if (choices > 0) {
+            int c = (int)(seed % choices);
+            for (int l : tn.out) {
+                if (l != back && c-- == 0) {
+                    pick = l;
+                    break;
+                }
+            }
+        }
+
+        TrafficLane& lane = lanes[pick];
+        if (!lane.pos.empty() && lane.pos.back() < VEHICLE_SPACING) {
+            break;
+        }
+        lane.pos.push_back(0.0f);
+        lane.speed.push_back(0.0f);
+        lane.seed.push_back(seed);
+        tn.queue.pop_front();
+    }
+}
+
+void Traffic::step()
+{
+    sync();
+
+    // lanes only touch their own arrays, intersections only the lanes leaving them
+    const int lane_blocks = ((int)lanes.size() + TRAFFIC_BLOCK - 1) / TRAFFIC_BLOCK;
+    workers.parallel_for(lane_blocks, [this](int b) {
+        int end = std::min((b + 1) * TRAFFIC_BLOCK, (int)lanes.size());
+        for (int l = b * TRAFFIC_BLOCK; l < end; l++) {
+            lane_step(lanes[l]);
+        }
+    });
+    const int node_blocks = ((int)nodes.size() + TRAFFIC_BLOCK - 1) / TRAFFIC_BLOCK;
+    workers.parallel_for(node_blocks, [this](int b) {
+        int end = std::min((b + 1) * TRAFFIC_BLOCK, (int)nodes.size());
+        for (int n = b * TRAFFIC_BLOCK; n < end; n++) {
+            node_step(n);
+        }
+    });
+}
+
+void Traffic::update(float dt)
+{
+    pending += dt;
+    int steps = 0;
+    while (pending >= TRAFFIC_STEP && steps < TRAFFIC_MAX_STEPS) {
+        step();
+        pending -= TRAFFIC_STEP;
+        steps++;
+    }
+    if (pending >= TRAFFIC_STEP) {
+        pending = 0.0f;
+    }
+}
+
+void Traffic::vehicle_positions(frame_vector<vec2<float>>& out) const
+{
+    auto center = [this](int cell) {
+        return vec2<float>{ cell % roads.width + 0.5f, cell / roads.width + 0.5f };
+    };
+    for (const TrafficLane& l : lanes) {
+        for (float p : l.pos) {
+            int k = std::min((int)p, (int)l.path.size() - 2);
+            float f = p - k;
+            vec2<float> a = center(l.path[k]);
+            vec2<float> b = center(l.path[k + 1]);
+            out.push_back(vec2<float>{ a.x + (b.x - a.x) * f, a.y + (b.y - a.y) * f });
+        }
+    }
+    for (const TrafficNode& tn : nodes) {
+        if (!tn.queue.empty()) {
+            out.push_back(center(tn.cell));
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "pse/pse.hpp"
+#include "road.hpp"
+
+constexpr float TRAFFIC_STEP = 1.0f / 30.0f; // seconds per simulation step
+constexpr int TRAFFIC_MAX_STEPS = 4; // per update, time beyond that is dropped
+constexpr float VEHICLE_SPEED = 2.0f; // tiles per second
+constexpr float VEHICLE_ACCEL = 4.0f;
+constexpr float VEHICLE_SPACING = 0.5f; // tiles from one vehicle to the next
+constexpr int INTERSECTION_QUEUE = 8; // vehicles waiting before the lanes into it back up
+constexpr int INTERSECTION_RELEASE = 1; // vehicles through an intersection per step
+
+/**
+ * Vehicles in one direction along a road edge. Positions are tiles from
+ * the node the lane starts at and run front to back, so each vehicle
+ * follows the one before it in the arrays.
+ */
+struct TrafficLane {
+    int from; // node
+    int to;
+    float length;
+    std::vector<int> path; // tiles from the start node to the end node
+    std::vector<float> pos;
+    std::vector<float> speed;
+    std::vector<uint32_t> seed; // picks each vehicle's turns
+    std::vector<uint8_t> occupancy; // vehicles on each tile of path
+    std::vector<uint32_t> arrived; // seeds of vehicles that reached the end this step
+    std::vector<float> gap; // scratch
+};
+
+struct TrafficWaiting {
+    uint32_t seed;
+    int from_lane; // -1 if it didn't come from one
+};
+
+struct TrafficSpot {
+    int cell;
+    int next; // -1 when waiting at an intersection
+    float frac;
+    float speed;
+    uint32_t seed;
+};
+
+struct TrafficNode {
+    int cell;
+    std::vector<int> in; // lanes ending here
+    std::vector<int> out; // lanes starting here
+    std::deque<TrafficWaiting> queue;
+};
+
+/**
+ * Vehicles driving along the road graph. Every lane follows its own
+ * leader and every intersection lets its queue into the lanes leaving
+ * it, so both run in parallel: lanes first, then intersections.
+ * The lanes of edges the roads retrace are rebuilt, vehicles on them
+ * stay on the tiles they were on if those are still road.
+ */
+class Traffic {
+public:
+    Traffic(RoadGraph& roads, pse::pool& workers);
+    bool spawn(int wx, int wy, uint32_t seed); // false if it isn't a road
+    void update(float dt); // steps the fixed timestep as many times as dt covers
+    void step();
+    size_t vehicle_count() const;
+    void vehicle_positions(pse::frame_vector<pse::vec2<float>>& out) const; // tile coordinates
+    std::vector<TrafficLane> lanes{}; // 2 per road edge, a to b then b to a
+    std::vector<TrafficNode> nodes{}; // by road node
+private:
+    RoadGraph& roads;
+    pse::pool& workers;
+    float pending = 0.0f; // seconds not simulated yet
+    std::vector<int> changed_edges{}; // scratch for sync
+    std::vector<int> changed_nodes{};
+    std::vector<TrafficSpot> spots{};
+
+    void lane_build(int e);
+    void rebuild();
+    void sync();
+    void lane_step(TrafficLane& lane);
+    void node_step(int node);
+};
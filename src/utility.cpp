@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <utility>
+
+#include "utility.hpp"
+
+void UtilityNetwork::resize(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    parent.assign(width * height, -1);
+    next.resize(width * height);
+    prev.resize(width * height);
+    for (int i = 0; i < width * height; i++) {
+        next[i] = prev[i] = i;
+    }
+    children.assign(width * height, 0);
+    count.assign(width * height, 0);
+    supply.assign(width * height * UTILITY_COUNT, 0);
+    sources.assign(width * height, 0);
+    seen.assign(width * height, 0);
+    stamp = 0;
+    edits++;
+}
+
+unsigned UtilityNetwork::revision() const
+{
+    return edits;
+}
+
+bool UtilityNetwork::conduit(int wx, int wy) const
+{
+    return parent[wy * width + wx] != -1;
+}
+
+/**
+ * Root of the network, halving the path on the way
+ */
+int UtilityNetwork::find(int cell)
+{
+    while (parent[cell] != cell) {
+        int up = parent[parent[cell]];
+        if (up != parent[cell]) {
+            children[parent[cell]]--;
+            children[up]++;
+            parent[cell] = up;
+        }
+        cell = up;
+    }
+    return cell;
+}
+
+/**
+ * The smaller network goes under the larger one, swapping
+ * where the roots point to joins the two rings into one
+ */
+void UtilityNetwork::unite(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+        return;
+    }
+    if (count[a] < count[b]) {
+        std::swap(a, b);
+    }
+    parent[b] = a;
+    children[a]++;
+    count[a] += count[b];
+    for (int k = 0; k < UTILITY_COUNT; k++) {
+        supply[a * UTILITY_COUNT + k] += supply[b * UTILITY_COUNT + k];
+    }
+    int na = next[a];
+    int nb = next[b];
+    next[a] = nb;
+    prev[nb] = a;
+    next[b] = na;
+    prev[na] = b;
+}
+
+/**
+ * Make the tile a network of its own
+ */
+void UtilityNetwork::single(int cell)
+{
+    parent[cell] = cell;
+    next[cell] = prev[cell] = cell;
+    children[cell] = 0;
+    count[cell] = 1;
+    for (int k = 0; k < UTILITY_COUNT; k++) {
+        supply[cell * UTILITY_COUNT + k] = (sources[cell] >> k) & 1;
+    }
+}
+
+void UtilityNetwork::add(int wx, int wy, int w, int h, unsigned sources)
+{
+    for (int i = wy; i < wy + h; i++) {
+        for (int j = wx; j < wx + w; j++) {
+            int cell = i * width + j;
+            if (parent[cell] == -1) {
+                this->sources[cell] = (uint8_t)sources;
+                single(cell);
+            }
+        }
+    }
+    // tiles on the edge of the rect join whatever is next to them
+    for (int i = wy; i < wy + h; i++) {
+        for (int j = wx; j < wx + w; j++) {
+            int cell = i * width + j;
+            if (j + 1 < width && parent[cell + 1] != -1) {
+                unite(cell, cell + 1);
+            }
+            if (i + 1 < height && parent[cell + width] != -1) {
+                unite(cell, cell + width);
+            }
+            if (j == wx && j > 0 && parent[cell - 1] != -1) {
+                unite(cell, cell - 1);
+            }
+            if (i == wy && i > 0 && parent[cell - width] != -1) {
+                unite(cell, cell - width);
+            }
+        }
+    }
+    edits++;
+}
+
+/**
+ * Split what is left of a network into the pieces still connected.
+ * Tiles taken out of it have parent -1 but are still in its ring.
+ */
+void UtilityNetwork::rebuild(int root)
+{
+    scratch.clear();
+    int cell = root;
+    do {
+        scratch.push_back(cell);
+        cell = next[cell];
+    } while (cell != root);
+
+    stamp++;
+    for (int c : scratch) {
+        next[c] = prev[c] = c;
+        children[c] = 0;
+        count[c] = 0;
+        if (parent[c] != -1) {
+            parent[c] = c;
+        }
+    }
+
+    // every piece is flat, each tile points straight at the root
+    for (int start : scratch) {
+        if (parent[start] == -1 || seen[start] == stamp) {
+            continue;
+        }
+        single(start);
+        seen[start] = stamp;
+        queue.clear();
+        queue.push_back(start);
+        for (size_t q = 0; q < queue.size(); q++) {
+            int c = queue[q];
+            int x = c % width;
+            int y = c / width;
+            const int around[4] = {
+                x + 1 < width ? c + 1 : -1,
+                y + 1 < height ? c + width : -1,
+                x > 0 ? c - 1 : -1,
+                y > 0 ? c - width : -1,
+            };
+            for (int n : around) {
+                if (n == -1 || parent[n] == -1 || seen[n] == stamp) {
+                    continue;
+                }
+                seen[n] = stamp;
+                parent[n] = start;
+                children[start]++;
+                next[n] = next[start];
+                prev[next[start]] = n;
+                prev[n] = start;
+                next[start] = n;
+                count[start]++;
+                for (int k = 0; k < UTILITY_COUNT; k++) {
+                    supply[start * UTILITY_COUNT + k] += (sources[n] >> k) & 1;
+                }
+                queue.push_back(n);
+            }
+        }
+    }
+}
+
+/**
+ * Take a tile out without a rebuild, only when it has at most one
+ * neighbour, so it can't split anything, and no path runs through it
+ */
+bool UtilityNetwork::unlink(int cell)
+{
+    const int x = cell % width;
+    const int y = cell / width;
+    int neighbours = (x + 1 < width && parent[cell + 1] != -1) + (y + 1 < height && parent[cell + width] != -1) +
+                     (x > 0 && parent[cell - 1] != -1) + (y > 0 && parent[cell - width] != -1);
+    int root = find(cell);
+    if (neighbours > 1 || children[cell] > 0 || (root == cell && count[root] > 1)) {
+        return false;
+    }
+
+    if (root != cell) {
+        children[parent[cell]]--;
+        count[root]--;
+        for (int k = 0; k < UTILITY_COUNT; k++) {
+            supply[root * UTILITY_COUNT + k] -= (sources[cell] >> k) & 1;
+        }
+    }
+    next[prev[cell]] = next[cell];
+    prev[next[cell]] = prev[cell];
+    next[cell] = prev[cell] = cell;
+    parent[cell] = -1;
+    sources[cell] = 0;
+    return true;
+}
+
+void UtilityNetwork::remove(int wx, int wy, int w, int h)
+{
+    if (w == 1 && h == 1 && parent[wy * width + wx] != -1 && unlink(wy * width + wx)) {
+        edits++;
+        return;
+    }
+
+    // find the networks first, taking tiles out breaks the paths to their roots
+    std::vector<int> roots;
+    stamp++;
+    for (int i = wy; i < wy + h; i++) {
+        for (int j = wx; j < wx + w; j++) {
+            int cell = i * width + j;
+            if (parent[cell] == -1) {
+                continue;
+            }
+            int r = find(cell);
+            if (seen[r] != stamp) {
+                seen[r] = stamp;
+                roots.push_back(r);
+            }
+        }
+    }
+    if (roots.empty()) {
+        return;
+    }
+
+    for (int i = wy; i < wy + h; i++) {
+        for (int j = wx; j < wx + w; j++) {
+            int cell = i * width + j;
+            parent[cell] = -1;
+            sources[cell] = 0;
+        }
+    }
+    for (int r : roots) {
+        rebuild(r);
+    }
+    edits++;
+}
+
+int UtilityNetwork::network(int wx, int wy)
+{
+    int cell = wy * width + wx;
+    return parent[cell] == -1 ? -1 : find(cell);
+}
+
+int UtilityNetwork::network_size(int wx, int wy)
+{
+    int r = network(wx, wy);
+    return r == -1 ? 0 : count[r];
+}
+
+bool UtilityNetwork::connected(int ax, int ay, int bx, int by)
+{
+    int a = network(ax, ay);
+    return a != -1 && a == network(bx, by);
+}
+
+bool UtilityNetwork::supplied(int wx, int wy, UtilityKind kind)
+{
+    int r = network(wx, wy);
+    return r != -1 && supply[r * UTILITY_COUNT + kind] > 0;
+}
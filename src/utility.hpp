@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum UtilityKind {
+    UTILITY_POWER,
+    UTILITY_WATER,
+    UTILITY_COUNT
+};
+
+/**
+ * Which conduit tiles connect to which, through their four neighbours,
+ * and how many sources of each utility every network has.
+ *
+ * The networks are a union-find, adding tiles joins them to their
+ * neighbours' networks. Removing tiles can split a network, which
+ * union-find can't undo, so only the networks that lost tiles are
+ * rebuilt from what is left of them. A lone tile at the end of a line
+ * that nothing points through is just unlinked instead. Every network
+ * keeps its tiles in a ring, which is how it is walked without the map.
+ */
+class UtilityNetwork {
+public:
+    void resize(int width, int height); // removes every conduit
+    void add(int wx, int wy, int w, int h, unsigned sources); // sources are 1 << UtilityKind bits each tile supplies
+    void remove(int wx, int wy, int w, int h);
+    bool conduit(int wx, int wy) const;
+    int network(int wx, int wy); // -1 if it isn't a conduit, only good until the next edit
+    int network_size(int wx, int wy); // tiles in it, 0 if it isn't a conduit
+    bool connected(int ax, int ay, int bx, int by);
+    bool supplied(int wx, int wy, UtilityKind kind); // on a network with a source of kind
+    unsigned revision() const; // changes with every edit
+    int width = 0;
+    int height = 0;
+private:
+    unsigned edits = 0;
+    std::vector<int> parent{}; // -1 if not a conduit
+    std::vector<int> next{}; // next tile of the same network
+    std::vector<int> prev{};
+    std::vector<int> children{}; // tiles whose parent this is
+    std::vector<int> count{}; // tiles in the network, on its root
+    std::vector<int> supply{}; // sources of each kind in the network, on its root
+    std::vector<uint8_t> sources{}; // what each tile supplies
+    std::vector<unsigned> seen{}; // stamped while rebuilding
+    unsigned stamp = 0;
+    std::vector<int> scratch{};
+    std::vector<int> queue{};
+
+    int find(int cell);
+    void unite(int a, int b);
+    void single(int cell);
+    bool unlink(int cell);
+    void rebuild(int root);
+};